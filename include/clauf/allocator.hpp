@@ -0,0 +1,153 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef CLAUF_ALLOCATOR_HPP_INCLUDED
+#define CLAUF_ALLOCATOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <lauf/vm.h>
+#include <new>
+#include <vector>
+
+namespace clauf
+{
+/// An allocator for native memory.
+///
+/// Small allocations are served from thread-local free lists, one for each power of two size
+/// class; larger ones are forwarded to the C library.
+/// Memory of small allocations is never returned to the system until the thread exits.
+namespace pool
+{
+    /// Allocates memory of the given size and alignment; returns nullptr on failure.
+    /// Small allocations can only be aligned up to their size rounded up to a power of two (at
+    /// least 16); a bigger alignment fails.
+    void* allocate(std::size_t size, std::size_t alignment);
+    /// As above, but the memory is zeroed.
+    /// Memory that has never been used before comes zeroed from the system, so this is cheaper
+    /// than allocating and zeroing.
+    void* allocate_zeroed(std::size_t size, std::size_t alignment);
+
+    /// Frees memory of the given size that was allocated by the pool.
+    void deallocate(void* ptr, std::size_t size);
+
+    /// Whether an allocation of old_size can be resized to new_size without moving it.
+    bool can_resize_in_place(std::size_t old_size, std::size_t new_size);
+} // namespace pool
+
+/// The allocators the heap of the VM can use.
+enum class heap_allocator
+{
+    /// The pool.
+    pool,
+    /// The C library.
+    malloc,
+    /// A bump allocator; memory is only freed all at once after execution.
+    arena,
+    /// Like the pool, but memory comes from transparent huge pages, which reduces TLB misses and
+    /// page faults.
+    hugepage,
+};
+
+/// The heap of the VM, which serves all heap allocations of the program.
+/// Builtins that allocate heap memory use it directly.
+namespace heap
+{
+    /// Selects the allocator; must be called before any memory is allocated.
+    void select(heap_allocator allocator);
+
+    /// The allocator to pass to the VM.
+    const lauf_vm_allocator& vm_allocator();
+
+    void* allocate(std::size_t size, std::size_t alignment);
+    void* allocate_zeroed(std::size_t size, std::size_t alignment);
+    void  deallocate(void* ptr, std::size_t size);
+
+    bool can_resize_in_place(std::size_t old_size, std::size_t new_size);
+
+    /// Frees all memory at once, which is only necessary for the arena.
+    /// Must be called only when no process is running.
+    void release();
+
+    /// The memory lauf has allocated through vm_allocator(); memory allocated by calling
+    /// allocate() directly isn't included.
+    struct statistics
+    {
+        std::uint64_t allocations   = 0;
+        std::uint64_t deallocations = 0;
+        std::size_t   current_bytes = 0;
+        std::size_t   peak_bytes    = 0;
+    };
+
+    const statistics& stats();
+} // namespace heap
+
+/// A standard allocator that uses the pool.
+template <typename T>
+struct pool_std_allocator
+{
+    using value_type = T;
+
+    pool_std_allocator() = default;
+    template <typename U>
+    pool_std_allocator(const pool_std_allocator<U>&)
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        auto ptr = pool::allocate(n * sizeof(T), alignof(T));
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, std::size_t n)
+    {
+        pool::deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    friend bool operator==(pool_std_allocator, pool_std_allocator<U>)
+    {
+        return true;
+    }
+    template <typename U>
+    friend bool operator!=(pool_std_allocator, pool_std_allocator<U>)
+    {
+        return false;
+    }
+};
+
+/// An allocator for memory that is freed all at once.
+class arena
+{
+public:
+    arena() : _cur(nullptr), _end(nullptr) {}
+
+    arena(const arena&)            = delete;
+    arena& operator=(const arena&) = delete;
+
+    ~arena();
+
+    /// Allocates memory of the given size, aligned for any scalar type; returns nullptr on failure.
+    void* allocate(std::size_t size);
+
+    /// Frees all memory allocated so far.
+    /// The first block is kept for further allocations.
+    void reset();
+
+private:
+    struct block
+    {
+        char*       memory;
+        std::size_t size;
+    };
+
+    std::vector<block> _blocks;
+    char*              _cur;
+    char*              _end;
+};
+} // namespace clauf
+
+#endif // CLAUF_ALLOCATOR_HPP_INCLUDED
+
@@ -11,8 +11,12 @@
 #include <dryad/symbol.hpp>
 #include <dryad/tree.hpp>
 #include <lexy/input/buffer.hpp>
+#include <optional>
+#include <string>
+#include <vector>
 
 #include <clauf/assert.hpp>
+#include <clauf/line_index.hpp>
 
 //=== types ===//
 namespace clauf
@@ -22,6 +26,8 @@ enum class native_specifier
     none,
     default_,
     string,
+    // A pointer to a buffer whose size is given by another parameter.
+    buffer,
 };
 
 enum class type_node_kind
@@ -381,9 +387,16 @@ struct name
 class file
 {
 public:
-    explicit file(const char* path, lexy::buffer<lexy::utf8_char_encoding>&& buffer)
-    : _buffer(LEXY_MOV(buffer)), _path(path)
-    {}
+    /// The buffer is the preprocessed text, whose lines come from the files in lines.
+    explicit file(const char* path, lexy::buffer<lexy::utf8_char_encoding>&& buffer,
+                  line_map&& lines = {})
+    : _buffer(LEXY_MOV(buffer)), _index(_buffer.data(), _buffer.size()), _lines(LEXY_MOV(lines)),
+      _path(path)
+    {
+        if (_lines.empty())
+            // The text wasn't preprocessed, so it is its own source.
+            _lines.add(1, _lines.add_source(path, _buffer.data(), _buffer.size()), 1);
+    }
 
     const lexy::buffer<lexy::utf8_char_encoding>& buffer() const
     {
@@ -407,8 +420,16 @@ public:
         return *result;
     }
 
+    /// The file, line and column a position in the buffer comes from.
+    line_map::position position_of(const char* ptr) const
+    {
+        return _lines.lookup(_index.lookup(ptr));
+    }
+
 private:
     lexy::buffer<lexy::utf8_char_encoding> _buffer;
+    line_index                             _index;
+    line_map                               _lines;
     const char*                            _path;
     dryad::node_map<const node, location>  _map;
 };
@@ -540,14 +561,47 @@ public:
         assert,
         malloc,
         free,
+        realloc,
+        calloc,
+        arena_create,
+        arena_alloc,
+        arena_reset,
+        arena_destroy,
+        printf,
+        sprintf,
+        puts,
+        map_file,
+        unmap_file,
+        map_create,
+        map_destroy,
+        map_size,
+        map_insert,
+        map_find,
+        map_erase,
+        map_insert_bytes,
+        map_find_bytes,
+        map_erase_bytes,
+        vector_create,
+        vector_destroy,
+        vector_size,
+        vector_push,
+        vector_pop,
+        vector_get,
+        vector_set,
+        sort,
+        io_submit_read,
+        io_submit_write,
+        io_wait,
+        bench,
+        now_ns,
     };
 
     explicit builtin_expr(dryad::node_ctor ctor, const clauf::type* ty, builtin_t builtin,
-                          clauf::expr* expr)
+                          expr_list arguments)
     : node_base(ctor, ty)
     {
         set_builtin_impl(builtin);
-        insert_child_after(nullptr, expr);
+        insert_child_list_after(nullptr, arguments);
     }
 
     builtin_t builtin() const
@@ -555,12 +609,39 @@ public:
         return builtin_impl();
     }
 
-    DRYAD_CHILD_NODE_GETTER(clauf::expr, expr, nullptr)
+    DRYAD_CHILD_NODE_RANGE_GETTER(expr, arguments, nullptr, this)
 
 private:
     DRYAD_ATTRIBUTE_USER_DATA16(builtin_t, builtin_impl);
 };
 
+/// A part of the format string of `__clauf_printf` or `__clauf_sprintf`.
+struct format_directive
+{
+    enum kind_t
+    {
+        literal,
+        sint,      // %d or %i
+        uint,      // %u
+        hex,       // %x
+        hex_upper, // %X
+        char_,     // %c
+        string,    // %s
+    };
+
+    kind_t kind;
+    // For a literal, the text that is printed.
+    std::string text;
+    // For a conversion, the minimal field width and the `-` and `0` flags.
+    unsigned width      = 0;
+    bool     left_align = false;
+    bool     zero_pad   = false;
+};
+
+/// Parses the format string; returns an empty optional if it is invalid or not supported.
+/// Only the flags `-` and `0`, a decimal field width and the conversions `diuxXcs%` are supported.
+std::optional<std::vector<format_directive>> parse_format_string(const char* format);
+
 /// A name, which refers to a declaration, e.g. `int i`
 class identifier_expr : public dryad::basic_node<node_kind::identifier_expr, expr>
 {
@@ -1167,9 +1248,19 @@ private:
 class parameter_decl : public dryad::basic_node<node_kind::parameter_decl, decl>
 {
 public:
-    explicit parameter_decl(dryad::node_ctor ctor, ast_symbol name, const clauf::type* type)
-    : node_base(ctor, name, type)
+    explicit parameter_decl(dryad::node_ctor ctor, ast_symbol name, const clauf::type* type,
+                            ast_symbol native_buffer_length = {})
+    : node_base(ctor, name, type), _native_buffer_length(native_buffer_length)
     {}
+
+    /// For a `__clauf_native_buffer(length)` parameter, the name of the length parameter.
+    ast_symbol native_buffer_length() const
+    {
+        return _native_buffer_length;
+    }
+
+private:
+    ast_symbol _native_buffer_length;
 };
 
 using parameter_list = dryad::unlinked_node_list<parameter_decl>;
@@ -1192,8 +1283,9 @@ class function_decl : public dryad::basic_node<node_kind::function_decl, decl>
 {
 public:
     explicit function_decl(dryad::node_ctor ctor, clauf::linkage linkage, ast_symbol name,
-                           const clauf::type* type, parameter_list params)
-    : node_base(ctor, name, type)
+                           const clauf::type* type, parameter_list params,
+                           ast_symbol native_buffer_length = {})
+    : node_base(ctor, name, type), _native_buffer_length(native_buffer_length)
     {
         set_linkage_impl(linkage);
         insert_child_list_after(nullptr, params);
@@ -1226,8 +1318,16 @@ public:
         decl::set_definition(def);
     }
 
+    /// For a `__clauf_native_buffer(length)` function, the name of the pointer parameter the
+    /// length of the returned buffer is stored into.
+    ast_symbol native_buffer_length() const
+    {
+        return _native_buffer_length;
+    }
+
 private:
-    node* _last_param;
+    node*      _last_param;
+    ast_symbol _native_buffer_length;
 };
 
 /// A struct declaration.
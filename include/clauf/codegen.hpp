@@ -9,19 +9,108 @@
 #include <ffi.h>
 #include <lauf/asm/builder.h>
 #include <lauf/asm/module.h>
+#include <lauf/runtime/process.h>
+#include <lauf/runtime/value.h>
 #include <lauf/vm.h>
+#include <memory>
 #include <optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace clauf
 {
 class diagnostic_logger;
 
+/// The native libraries symbols of native functions are resolved in.
+class native_libraries
+{
+public:
+    native_libraries() = default;
+
+    native_libraries(const native_libraries&)            = delete;
+    native_libraries& operator=(const native_libraries&) = delete;
+
+    ~native_libraries();
+
+    /// Loads the library at the path.
+    /// If that fails, returns an error message, otherwise, returns nothing.
+    std::optional<std::string> add(const char* path);
+
+    /// Searches the libraries in the order they were added, followed by the global symbols of the
+    /// process itself.
+    void* lookup(const char* symbol) const;
+
+private:
+    std::vector<void*> _handles;
+};
+
+/// Discards the state builtins keep for a process, like arenas, containers, and file mappings.
+/// It must be called before re-executing a program in the same VM.
+void reset_builtin_state();
+
+/// Tracks the source location of every heap allocation, so leaks can be reported.
+/// It must be called before the program is compiled.
+void enable_memory_report();
+/// Prints the memory usage of the program to stderr, followed by the heap blocks leaked by the last
+/// execution, grouped by the call that allocated them.
+void print_memory_report();
+
+/// A native function, its symbol and cif are resolved on the first call.
 struct ffi_function
 {
-    ffi_cif                cif;
-    void*                  addr;
-    std::vector<ffi_type*> argument_types;
+    std::string             name;
+    const native_libraries* libraries;
+    std::vector<ffi_type*>  argument_types;
+    ffi_type*               return_type;
+
+    void*   addr         = nullptr;
+    bool    cif_prepared = false;
+    ffi_cif cif;
+};
+
+/// The libffi type of a struct passed by value to or from native code.
+struct ffi_struct_type
+{
+    const struct_decl* decl;
+    ffi_type           type;
+    // Null-terminated, as required by libffi.
+    std::vector<ffi_type*> elements;
+};
+
+/// The signature of an interpreted function that is passed to native code as a function pointer.
+struct native_callback
+{
+    /// A libffi closure that calls an interpreted function.
+    struct closure
+    {
+        struct deleter
+        {
+            void operator()(ffi_closure* closure) const
+            {
+                ffi_closure_free(closure);
+            }
+        };
+
+        native_callback*                      callback;
+        lauf_runtime_function_address         function;
+        lauf_runtime_process*                 process;
+        void*                                 code;
+        std::unique_ptr<ffi_closure, deleter> ffi;
+    };
+
+    const function_type*     type;
+    lauf_asm_signature       signature;
+    std::vector<ffi_type*>   argument_types;
+    ffi_type*                return_type;
+    // For pointer arguments, the size of the object they point to or -1 if unknown.
+    std::vector<std::size_t> argument_sizes;
+
+    bool    cif_prepared = false;
+    ffi_cif cif;
+
+    // The closures that have been created for this signature, indexed by the function address.
+    std::unordered_map<std::uint64_t, std::unique_ptr<closure>> closures;
 };
 
 class code
@@ -35,7 +124,10 @@ public:
             lauf_asm_destroy_module(_module);
     }
 
-    code(code&& other) noexcept : _module(other._module), _functions(std::move(other._functions))
+    code(code&& other) noexcept
+    : _module(other._module), _functions(std::move(other._functions)),
+      _callbacks(std::move(other._callbacks)), _struct_types(std::move(other._struct_types)),
+      _names(std::move(other._names))
     {
         other._module = nullptr;
     }
@@ -43,6 +135,9 @@ public:
     {
         std::swap(_module, other._module);
         std::swap(_functions, other._functions);
+        std::swap(_callbacks, other._callbacks);
+        std::swap(_struct_types, other._struct_types);
+        std::swap(_names, other._names);
         return *this;
     }
 
@@ -57,16 +152,58 @@ public:
         return &_functions.back();
     }
 
+    native_callback* lookup_native_callback(const function_type* type)
+    {
+        for (auto& callback : _callbacks)
+            if (callback.type == type)
+                return &callback;
+        return nullptr;
+    }
+    native_callback* add_native_callback(native_callback callback)
+    {
+        _callbacks.push_back(std::move(callback));
+        return &_callbacks.back();
+    }
+
+    ffi_struct_type* lookup_ffi_struct_type(const struct_decl* decl)
+    {
+        for (auto& type : _struct_types)
+            if (type.decl == decl)
+                return &type;
+        return nullptr;
+    }
+    ffi_struct_type* add_ffi_struct_type(ffi_struct_type type)
+    {
+        _struct_types.push_back(std::move(type));
+        // The elements have been moved, so the type needs to refer to the new location.
+        auto& result         = _struct_types.back();
+        result.type.elements = result.elements.data();
+        return &result;
+    }
+
+    /// Keeps a name of the module alive that isn't in the AST, like a mangled one.
+    const char* add_name(std::string name)
+    {
+        _names.push_back(std::move(name));
+        return _names.back().c_str();
+    }
+
 private:
-    lauf_asm_module*         _module;
-    std::deque<ffi_function> _functions;
+    lauf_asm_module*            _module;
+    std::deque<ffi_function>    _functions;
+    std::deque<native_callback> _callbacks;
+    std::deque<ffi_struct_type> _struct_types;
+    std::deque<std::string>     _names;
 };
 
+/// Generates the code of one or more translation units into a single module.
+///
+/// Each translation unit is declared while it is parsed; once all are declared, and the extern
+/// declarations have been linked to their definitions, the definitions of each are generated.
 class codegen
 {
 public:
-    explicit codegen(lauf_vm* vm, diagnostic_logger& logger, const file& f,
-                     const ast_symbol_interner& sym);
+    explicit codegen(lauf_vm* vm, const native_libraries& libraries);
 
     codegen(const codegen&)            = delete;
     codegen& operator=(const codegen&) = delete;
@@ -77,19 +214,35 @@ public:
         lauf_asm_destroy_builder(_chunk_builder);
     }
 
+    /// Sets the translation unit of the following declarations.
+    void set_translation_unit(diagnostic_logger& logger, const file& f,
+                              const ast_symbol_interner& sym);
+
     void declare_global(const variable_decl* decl);
     void declare_function(const function_decl* decl);
 
     std::size_t constant_eval_integer_expr(const expr* expr);
 
-    std::optional<code> finish(const ast& ast) &&;
+    /// Generates the definitions of the translation unit; returns false on error.
+    bool define(diagnostic_logger& logger, const ast& ast);
+
+    code finish() &&
+    {
+        return std::move(_code);
+    }
 
 private:
+    // The name of the declaration in the module.
+    const char* name_of(const decl* decl);
+
     lauf_vm*                   _vm;
     diagnostic_logger*         _logger;
     const file*                _file;
     const ast_symbol_interner* _symbols;
+    const char*                _debug_path;
+    const native_libraries*    _libraries;
 
+    code              _code;
     lauf_asm_module*  _mod;
     lauf_asm_builder* _body_builder;
     lauf_asm_builder* _chunk_builder;
@@ -98,6 +251,9 @@ private:
 
     dryad::node_map<const clauf::variable_decl, lauf_asm_global*>   _globals;
     dryad::node_map<const clauf::function_decl, lauf_asm_function*> _functions;
+    // Every translation unit declares the native functions it calls, but they share the lauf
+    // function of the first declaration.
+    std::unordered_map<std::string, const clauf::function_decl*> _native_functions;
 };
 } // namespace clauf
 
@@ -9,6 +9,7 @@
 #include <lauf/asm/module.h>
 #include <lexy/input/buffer.hpp>
 #include <optional>
+#include <vector>
 
 struct lauf_vm;
 
@@ -16,13 +17,18 @@ namespace clauf
 {
 struct compilation_result
 {
-    clauf::ast ast;
-    code       code;
+    // One for each translation unit.
+    std::vector<clauf::ast> asts;
+    code                    code;
 };
 
-/// If input is well-formed C (including name lookup and type checking), return its AST.
+/// If the inputs are well-formed C (including name lookup and type checking), return their ASTs.
 /// Otherwise, log error and return nothing.
-std::optional<compilation_result> compile(lauf_vm* vm, file&& input);
+/// Each input is a separate translation unit; extern declarations are linked across them, and the
+/// code of all of them is in the same module.
+/// Native functions are resolved in the libraries, which must outlive the resulting code.
+std::optional<compilation_result> compile(lauf_vm* vm, const native_libraries& libraries,
+                                          std::vector<file>&& inputs);
 } // namespace clauf
 
 #endif // CLAUF_COMPILER_HPP_INCLUDED
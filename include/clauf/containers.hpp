@@ -0,0 +1,107 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef CLAUF_CONTAINERS_HPP_INCLUDED
+#define CLAUF_CONTAINERS_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <clauf/allocator.hpp>
+
+namespace clauf
+{
+/// A hash map from integers or byte strings to integers, exposed to programs via builtins.
+///
+/// It uses open addressing with a byte of metadata per slot, which stores part of the hash.
+/// Lookup compares the metadata of 16 slots at once.
+class hash_map
+{
+public:
+    hash_map() = default;
+
+    std::size_t size() const
+    {
+        return _ints.size() + _bytes.size();
+    }
+
+    /// Inserts or assigns the value; returns true if the key was inserted.
+    bool insert(std::uint64_t key, std::uint64_t value)
+    {
+        return _ints.insert(key, value);
+    }
+    bool insert(const char* key, std::size_t length, std::uint64_t value)
+    {
+        return _bytes.insert(std::string(key, length), value);
+    }
+
+    /// Returns a pointer to the value or nullptr if the key is not in the map.
+    const std::uint64_t* find(std::uint64_t key) const
+    {
+        return _ints.find(key);
+    }
+    const std::uint64_t* find(const char* key, std::size_t length) const
+    {
+        return _bytes.find(std::string_view(key, length));
+    }
+
+    /// Removes the key; returns true if it was in the map.
+    bool erase(std::uint64_t key)
+    {
+        return _ints.erase(key);
+    }
+    bool erase(const char* key, std::size_t length)
+    {
+        return _bytes.erase(std::string_view(key, length));
+    }
+
+private:
+    /// Lookup is the type used for keys that are only compared against.
+    template <typename Key, typename Lookup>
+    class table
+    {
+    public:
+        std::size_t size() const
+        {
+            return _size;
+        }
+
+        const std::uint64_t* find(const Lookup& key) const;
+
+        bool insert(Key key, std::uint64_t value);
+
+        bool erase(const Lookup& key);
+
+    private:
+        struct slot
+        {
+            Key           key;
+            std::uint64_t value;
+        };
+
+        std::size_t find_index(const Lookup& key, std::uint64_t hash) const;
+        std::size_t find_free(std::uint64_t hash) const;
+        void        set_control(std::size_t idx, std::uint8_t value);
+        void        rehash(std::size_t capacity);
+
+        // The control bytes of the first group are repeated at the end, so a group can be loaded
+        // at any index.
+        std::vector<std::uint8_t, pool_std_allocator<std::uint8_t>> _control;
+        std::vector<slot, pool_std_allocator<slot>>                 _slots;
+        std::size_t                                                 _size    = 0;
+        std::size_t                                                 _deleted = 0;
+    };
+
+    table<std::uint64_t, std::uint64_t>  _ints;
+    table<std::string, std::string_view> _bytes;
+};
+
+/// A growable array of integers, exposed to programs via builtins.
+using int_vector = std::vector<std::uint64_t, pool_std_allocator<std::uint64_t>>;
+} // namespace clauf
+
+#endif // CLAUF_CONTAINERS_HPP_INCLUDED
+
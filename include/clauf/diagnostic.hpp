@@ -4,8 +4,13 @@
 #ifndef CLAUF_DIAGNOSTIC_HPP_INCLUDED
 #define CLAUF_DIAGNOSTIC_HPP_INCLUDED
 
-#include <clauf/ast.hpp>
+#include <algorithm>
+#include <cstdarg>
+#include <lexy/input/string_input.hpp>
 #include <lexy_ext/report_error.hpp>
+#include <type_traits>
+
+#include <clauf/ast.hpp>
 
 namespace clauf
 {
@@ -14,7 +19,11 @@ using lexy_ext::diagnostic_kind;
 
 class diagnostic_logger
 {
+    using source_input = lexy::string_input<lexy::utf8_char_encoding>;
+
 public:
+    /// A logger for diagnostics that don't belong to a parsed file, like those of the preprocessor.
+    diagnostic_logger() : _file(nullptr), _errored(false) {}
     explicit diagnostic_logger(const file& file) : _file(&file), _errored(false) {}
 
     explicit operator bool() const
@@ -25,64 +34,178 @@ public:
     class writer
     {
     public:
+        /// Annotates a location in the file of the logger.
+        /// It is reported in the file and line it was preprocessed from.
         [[gnu::format(printf, 4, 5), nodiscard]] writer& annotation(lexy_ext::annotation_kind kind,
                                                                     clauf::location           loc,
                                                                     const char* fmt, ...)
         {
-            auto begin_loc = lexy::get_input_location(_file->buffer(), loc.begin);
+            auto position = _file->position_of(loc.begin);
+            auto source   = position.file;
+
+            auto begin  = source->find(position.line_nr, position.column_nr);
+            auto length = std::min(std::size_t(loc.end - loc.begin),
+                                   std::size_t(source->data + source->size - begin));
 
             va_list args;
             va_start(args, fmt);
-            _impl.write_empty_annotation(lexy::cfile_output_iterator{stderr});
-            _impl.write_annotation(lexy::cfile_output_iterator{stderr}, kind, begin_loc, loc.end,
-                                   [&](auto out, lexy::visualization_options) {
-                                       std::vfprintf(stderr, fmt, args);
-                                       return out;
-                                   });
+            write_annotation(kind, *source, {begin, begin + length}, fmt, args);
             va_end(args);
             return *this;
         }
 
-        void finish() {}
+        /// Annotates a location in the text of a source file.
+        [[gnu::format(printf, 5, 6), nodiscard]] writer& source_annotation(
+            lexy_ext::annotation_kind kind, const line_map::source& source, clauf::location loc,
+            const char* fmt, ...)
+        {
+            va_list args;
+            va_start(args, fmt);
+            write_annotation(kind, source, loc, fmt, args);
+            va_end(args);
+            return *this;
+        }
+
+        void finish()
+        {
+            if (_path == nullptr && _file != nullptr)
+            {
+                source_input input;
+                lexy_ext::diagnostic_writer<source_input> impl(input, {lexy::visualize_fancy});
+                impl.write_path(lexy::cfile_output_iterator{stderr}, _file->path());
+            }
+        }
 
     private:
-        writer(const file* file) : _file(file), _impl(file->buffer(), {lexy::visualize_fancy}) {}
+        writer(const file* file) : _file(file), _path(nullptr) {}
+
+        [[gnu::format(printf, 5, 0)]] void write_annotation(lexy_ext::annotation_kind kind,
+                                                            const line_map::source&   source,
+                                                            clauf::location loc, const char* fmt,
+                                                            va_list args)
+        {
+            source_input input(source.data, source.size);
+            lexy_ext::diagnostic_writer<source_input> impl(input, {lexy::visualize_fancy});
+
+            // Annotations can be in different files, e.g. when one is in an included header.
+            if (_path == nullptr || source.path != _path)
+            {
+                _path = source.path.c_str();
+                impl.write_path(lexy::cfile_output_iterator{stderr}, _path);
+            }
+
+            auto begin_loc = lexy::get_input_location(input, loc.begin);
+            impl.write_empty_annotation(lexy::cfile_output_iterator{stderr});
+            impl.write_annotation(lexy::cfile_output_iterator{stderr}, kind, begin_loc, loc.end,
+                                  [&](auto out, lexy::visualization_options) {
+                                      std::vfprintf(stderr, fmt, args);
+                                      return out;
+                                  });
+        }
 
-        const file*                                                         _file;
-        lexy_ext::diagnostic_writer<lexy::buffer<lexy::utf8_char_encoding>> _impl;
+        const file* _file;
+        // The path of the file that the last annotation was in.
+        const char* _path;
 
         friend diagnostic_logger;
     };
 
     [[gnu::format(printf, 3, 4)]] writer log(lexy_ext::diagnostic_kind kind, const char* fmt, ...)
     {
-        writer  result(_file);
         va_list args;
         va_start(args, fmt);
+        auto result = vlog(kind, fmt, args);
+        va_end(args);
+        return result;
+    }
 
-        result._impl.write_message(lexy::cfile_output_iterator{stderr}, kind,
-                                   [&](auto out, lexy::visualization_options) {
-                                       std::vfprintf(stderr, fmt, args);
-                                       return out;
-                                   });
-        result._impl.write_path(lexy::cfile_output_iterator{stderr}, _file->path());
+    [[gnu::format(printf, 3, 0)]] writer vlog(lexy_ext::diagnostic_kind kind, const char* fmt,
+                                              va_list args)
+    {
+        source_input                              input;
+        lexy_ext::diagnostic_writer<source_input> impl(input, {lexy::visualize_fancy});
+        impl.write_message(lexy::cfile_output_iterator{stderr}, kind,
+                           [&](auto out, lexy::visualization_options) {
+                               std::vfprintf(stderr, fmt, args);
+                               return out;
+                           });
 
-        va_end(args);
         if (kind == lexy_ext::diagnostic_kind::error)
             _errored = true;
-        return result;
+        return writer(_file);
     }
 
-    auto error_callback() const
+    /// Reports parse errors like lexy_ext::report_error, but in the files the input was
+    /// preprocessed from.
+    auto error_callback()
     {
-        return lexy_ext::report_error.opts({lexy::visualize_fancy}).path(_file->path());
+        return parse_error_callback{this};
     }
 
 private:
+    struct parse_error_callback
+    {
+        struct sink_t
+        {
+            diagnostic_logger* logger;
+            std::size_t        count;
+
+            using return_type = std::size_t;
+
+            template <typename Context, typename Reader, typename Tag>
+            void operator()(const Context& context, const lexy::error<Reader, Tag>& error)
+            {
+                auto writer = logger->log(lexy_ext::diagnostic_kind::error, "while parsing %s",
+                                          context.production());
+
+                auto context_line = logger->_file->position_of(context.position()).line_nr;
+                auto error_line   = logger->_file->position_of(error.position()).line_nr;
+                if (context_line != error_line)
+                    (void)writer.annotation(lexy_ext::annotation_kind::secondary,
+                                            {context.position(), context.position() + 1},
+                                            "beginning here");
+
+                auto kind = lexy_ext::annotation_kind::primary;
+                if constexpr (std::is_same_v<Tag, lexy::expected_literal>)
+                    (void)writer.annotation(kind,
+                                            {error.position(),
+                                             error.position() + error.index() + 1},
+                                            "expected '%.*s'", int(error.length()),
+                                            error.string());
+                else if constexpr (std::is_same_v<Tag, lexy::expected_keyword>)
+                    (void)writer.annotation(kind, {error.position(), error.end()},
+                                            "expected keyword '%.*s'", int(error.length()),
+                                            error.string());
+                else if constexpr (std::is_same_v<Tag, lexy::expected_char_class>)
+                    (void)writer.annotation(kind, {error.position(), error.position() + 1},
+                                            "expected %s", error.name());
+                else
+                    (void)writer.annotation(kind, {error.position(), error.end()}, "%s",
+                                            error.message());
+                writer.finish();
+
+                ++count;
+            }
+
+            std::size_t finish() &&
+            {
+                return count;
+            }
+        };
+
+        diagnostic_logger* logger;
+
+        using return_type = std::size_t;
+
+        auto sink() const
+        {
+            return sink_t{logger, 0};
+        }
+    };
+
     const file* _file;
     bool        _errored;
 };
 } // namespace clauf
 
 #endif // CLAUF_DIAGNOSTIC_HPP_INCLUDED
-
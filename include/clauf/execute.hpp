@@ -0,0 +1,51 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef CLAUF_EXECUTE_HPP_INCLUDED
+#define CLAUF_EXECUTE_HPP_INCLUDED
+
+#include <lauf/asm/module.h>
+#include <lauf/asm/program.h>
+#include <optional>
+
+struct lauf_vm;
+
+namespace clauf
+{
+/// Returns the main function of the module.
+/// If there is none or its signature is wrong, prints an error and returns nullptr.
+const lauf_asm_function* find_main(lauf_asm_module* mod);
+
+/// A program whose main function can be executed repeatedly, e.g. once per request or per fuzzing
+/// input.
+///
+/// The program is created once and acts as a snapshot of the initial state: every execution starts
+/// with fresh copies of the globals and an empty heap, and the state the builtins kept for the
+/// previous execution, like arenas or containers, is discarded.
+/// This way, only the program itself is re-used and nothing needs to be compiled or initialized
+/// again.
+class executable
+{
+public:
+    explicit executable(lauf_vm* vm, lauf_asm_module* mod, const lauf_asm_function* main_fn)
+    : _vm(vm), _program(lauf_asm_create_program(mod, main_fn))
+    {}
+
+    executable(const executable&)            = delete;
+    executable& operator=(const executable&) = delete;
+
+    ~executable()
+    {
+        lauf_asm_destroy_program(_program);
+    }
+
+    /// Executes main and returns its exit code, or nothing if the program panicked.
+    std::optional<int> execute();
+
+private:
+    lauf_vm*         _vm;
+    lauf_asm_program _program;
+};
+} // namespace clauf
+
+#endif // CLAUF_EXECUTE_HPP_INCLUDED
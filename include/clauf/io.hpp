@@ -0,0 +1,32 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef CLAUF_IO_HPP_INCLUDED
+#define CLAUF_IO_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace clauf
+{
+/// A read or write of a file at an offset, like pread() and pwrite().
+struct io_request
+{
+    int           fd;
+    bool          is_write;
+    void*         buffer;
+    std::size_t   length;
+    std::uint64_t offset;
+    /// Set once the request has been executed: the number of bytes transferred or -errno.
+    std::int64_t result = 0;
+};
+
+/// Executes all requests and waits until they are completed.
+///
+/// Requests are submitted in batches to an io_uring, so a batch needs only a single system call.
+/// If io_uring is not available, they are executed one after the other instead.
+void execute_io(std::vector<io_request>& requests);
+} // namespace clauf
+
+#endif // CLAUF_IO_HPP_INCLUDED
@@ -0,0 +1,98 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef CLAUF_LINE_INDEX_HPP_INCLUDED
+#define CLAUF_LINE_INDEX_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace clauf
+{
+/// The offsets where the lines of a source file begin.
+///
+/// It is computed once, scanning many bytes at a time for newlines, so the line and column of a
+/// position is found by binary search instead of scanning the file up to it.
+class line_index
+{
+public:
+    line_index() : _begin(nullptr) {}
+    explicit line_index(const char* begin, std::size_t size);
+
+    struct position
+    {
+        // Both are one-based; the column counts code points, like lexy does.
+        unsigned line_nr;
+        unsigned column_nr;
+    };
+
+    /// The position of ptr, which must point into the file.
+    position lookup(const char* ptr) const;
+
+    std::size_t line_count() const
+    {
+        return _line_begins.size();
+    }
+
+private:
+    const char*                _begin;
+    std::vector<std::uint32_t> _line_begins;
+};
+
+/// Maps the lines of preprocessed source text back to the files and lines they come from.
+class line_map
+{
+public:
+    /// A file that contributed lines to the text.
+    struct source
+    {
+        std::string path;
+        const char* data;
+        std::size_t size;
+
+        /// The position of the line and column in data, or the end of the line if it is shorter.
+        const char* find(unsigned line_nr, unsigned column_nr) const;
+    };
+
+    struct position
+    {
+        const source* file;
+        unsigned      line_nr;
+        unsigned      column_nr;
+    };
+
+    bool empty() const
+    {
+        return _segments.empty();
+    }
+
+    /// Adds a file, whose text must outlive the map, and returns its index.
+    unsigned add_source(std::string path, const char* data, std::size_t size);
+
+    const source& source_at(unsigned index) const
+    {
+        return _sources[index];
+    }
+
+    /// Records that the lines starting at output_line_nr come from the file starting at line_nr.
+    void add(unsigned output_line_nr, unsigned source, unsigned line_nr);
+
+    /// The file and position in it of a position in the text.
+    position lookup(line_index::position pos) const;
+
+private:
+    struct segment
+    {
+        unsigned output_line_nr;
+        unsigned source;
+        unsigned line_nr;
+    };
+
+    std::vector<source>  _sources;
+    std::vector<segment> _segments;
+};
+} // namespace clauf
+
+#endif // CLAUF_LINE_INDEX_HPP_INCLUDED
@@ -0,0 +1,79 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef CLAUF_PREPROCESSOR_HPP_INCLUDED
+#define CLAUF_PREPROCESSOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <clauf/line_index.hpp>
+
+namespace clauf
+{
+class diagnostic_logger;
+
+/// The files included by programs.
+///
+/// Each file is mapped into memory once and shared by all includes of all programs preprocessed
+/// with the same cache.
+/// If a file is guarded by an include guard or #pragma once, this is remembered, so including it
+/// again costs a lookup instead of preprocessing it.
+class include_cache
+{
+public:
+    struct entry
+    {
+        std::string path;
+        const char* data;
+        std::size_t size;
+
+        // Whether the file has been preprocessed once, which determines the guard.
+        bool scanned = false;
+        // If the entire file is inside #ifndef guard ... #endif, the macro of the guard.
+        std::string guard;
+        bool        pragma_once = false;
+    };
+
+    include_cache() = default;
+
+    include_cache(const include_cache&)            = delete;
+    include_cache& operator=(const include_cache&) = delete;
+
+    ~include_cache();
+
+    /// Returns the file at the path, or nullptr if it cannot be read.
+    entry* load(const std::string& path);
+
+private:
+    // Indexed by the canonical path, so different spellings of the same file share an entry.
+    std::unordered_map<std::string, std::unique_ptr<entry>> _entries;
+};
+
+/// The text of a preprocessed file and the lines it comes from.
+struct preprocessed_file
+{
+    std::string text;
+    line_map    lines;
+};
+
+/// Handles the directives #include, #define, #undef, #if, #ifdef, #ifndef, #elif, #else, #endif,
+/// #error and #pragma once, and expands object-like and function-like macros.
+///
+/// The result is a single source text, where each directive is replaced by an empty line and each
+/// #include by the contents of the file; the line map records the file and line of every line.
+/// The data of the file must outlive the result.
+/// Files in "quotes" are searched relative to the including file first, then in the include
+/// directories; files in <brackets> only in the include directories.
+/// If there is an error, it is logged and nothing is returned.
+std::optional<preprocessed_file> preprocess(include_cache&                  cache,
+                                            const std::vector<std::string>& include_dirs,
+                                            diagnostic_logger& logger, const char* path,
+                                            const char* data, std::size_t size);
+} // namespace clauf
+
+#endif // CLAUF_PREPROCESSOR_HPP_INCLUDED
@@ -0,0 +1,26 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef CLAUF_SORT_HPP_INCLUDED
+#define CLAUF_SORT_HPP_INCLUDED
+
+#include <cstddef>
+
+namespace clauf
+{
+/// The integer key of the elements that are sorted.
+struct sort_key
+{
+    std::size_t offset; // in bytes, relative to the start of the element
+    std::size_t size;   // 1 to 8 bytes
+    bool        is_signed;
+};
+
+/// Sorts count elements of the given size that start at base by their key.
+/// The sort is stable.
+///
+/// Large inputs are sorted by a radix sort, which needs one pass per key byte.
+void sort(void* base, std::size_t count, std::size_t elem_size, sort_key key);
+} // namespace clauf
+
+#endif // CLAUF_SORT_HPP_INCLUDED
@@ -0,0 +1,450 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#include <clauf/allocator.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unordered_set>
+
+namespace
+{
+constexpr auto min_size_class   = std::size_t(16);
+constexpr auto max_size_class   = std::size_t(2048);
+constexpr auto size_class_count = std::size_t(8);
+// Chunks are obtained from the system and split into blocks of a single size class.
+constexpr auto chunk_size = std::size_t(64) * 1024;
+
+std::size_t size_class_index(std::size_t size)
+{
+    auto idx = std::size_t(0);
+    while ((min_size_class << idx) < size)
+        ++idx;
+    return idx;
+}
+
+struct free_block
+{
+    free_block* next;
+};
+
+// Huge pages are requested for regions of that size and alignment.
+constexpr auto huge_page_size = std::size_t(2) * 1024 * 1024;
+
+// Returns memory of the given size (a multiple of huge_page_size) that is aligned for a huge page
+// and marked for transparent huge pages, or nullptr.
+// The alignment can be bigger than a huge page.
+void* map_huge_pages(std::size_t size, std::size_t alignment = huge_page_size)
+{
+    alignment = std::max(alignment, huge_page_size);
+
+    // We over-allocate to be able to align it and unmap the excess.
+    auto mapped_size = size + alignment;
+    auto mapped      = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        return nullptr;
+
+    auto begin   = static_cast<char*>(mapped);
+    auto aligned = reinterpret_cast<char*>(
+        (reinterpret_cast<std::uintptr_t>(begin) + alignment - 1) & ~(alignment - 1));
+    if (aligned != begin)
+        munmap(begin, std::size_t(aligned - begin));
+    if (auto excess = mapped_size - std::size_t(aligned - begin) - size; excess > 0)
+        munmap(aligned + size, excess);
+
+    // This is only a hint, the kernel might not have huge pages available.
+    madvise(aligned, size, MADV_HUGEPAGE);
+    return aligned;
+}
+
+std::size_t round_to_huge_pages(std::size_t size)
+{
+    return (size + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+struct pool_state
+{
+    struct size_class
+    {
+        free_block* free_list = nullptr;
+        // The part of the current chunk that hasn't been handed out yet; it is still zeroed.
+        char* cur = nullptr;
+        char* end = nullptr;
+    };
+
+    size_class classes[size_class_count];
+    // If huge_pages is true, chunks are carved out of huge page regions, which are stored in
+    // regions; otherwise, they are stored in chunks.
+    bool               huge_pages;
+    std::vector<void*> chunks;
+    std::vector<void*> regions;
+    char*              region_cur = nullptr;
+    char*              region_end = nullptr;
+
+    explicit pool_state(bool huge_pages) : huge_pages(huge_pages) {}
+
+    pool_state(const pool_state&)            = delete;
+    pool_state& operator=(const pool_state&) = delete;
+
+    ~pool_state()
+    {
+        for (auto chunk : chunks)
+            munmap(chunk, chunk_size);
+        for (auto region : regions)
+            munmap(region, huge_page_size);
+    }
+
+    // Memory of a chunk is page aligned, so every block is aligned to its size, and
+    // zeroed.
+    void* allocate_chunk()
+    {
+        if (!huge_pages)
+        {
+            auto chunk = mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (chunk == MAP_FAILED)
+                return nullptr;
+            chunks.push_back(chunk);
+            return chunk;
+        }
+
+        if (region_cur == region_end)
+        {
+            auto region = map_huge_pages(huge_page_size);
+            if (region == nullptr)
+                return nullptr;
+            regions.push_back(region);
+
+            region_cur = static_cast<char*>(region);
+            region_end = region_cur + huge_page_size;
+        }
+
+        auto chunk = region_cur;
+        region_cur += chunk_size;
+        return chunk;
+    }
+
+    void* allocate(std::size_t idx, bool zeroed)
+    {
+        auto& cls = classes[idx];
+        if (auto block = cls.free_list)
+        {
+            cls.free_list = block->next;
+            if (zeroed)
+                std::memset(block, 0, min_size_class << idx);
+            return block;
+        }
+
+        if (cls.cur == cls.end)
+        {
+            auto chunk = allocate_chunk();
+            if (chunk == nullptr)
+                return nullptr;
+
+            cls.cur = static_cast<char*>(chunk);
+            cls.end = cls.cur + chunk_size;
+        }
+
+        auto result = cls.cur;
+        cls.cur += min_size_class << idx;
+        return result;
+    }
+
+    void deallocate(void* ptr, std::size_t idx)
+    {
+        auto block             = static_cast<free_block*>(ptr);
+        block->next            = classes[idx].free_list;
+        classes[idx].free_list = block;
+    }
+};
+
+thread_local pool_state thread_pool(false);
+thread_local pool_state thread_huge_pool(true);
+
+void* allocate_large(std::size_t size, std::size_t alignment, bool zeroed)
+{
+    if (alignment <= alignof(std::max_align_t))
+        // For large allocations, calloc() gets fresh pages from the system that are already zeroed.
+        return zeroed ? std::calloc(1, size) : std::malloc(size);
+
+    void* result = nullptr;
+    if (posix_memalign(&result, alignment, size) != 0)
+        return nullptr;
+    if (zeroed)
+        std::memset(result, 0, size);
+    return result;
+}
+
+// Deallocation only knows the size, so the size alone determines where memory comes from.
+// Blocks of a size class are aligned to their size, so a small allocation can't be aligned any
+// further; huge pages can be aligned to anything.
+void* allocate_impl(pool_state& pool, std::size_t size, std::size_t alignment, bool zeroed)
+{
+    if (size <= max_size_class)
+    {
+        auto idx = size_class_index(size);
+        if (alignment > (min_size_class << idx))
+            return nullptr;
+        return pool.allocate(idx, zeroed);
+    }
+    else if (pool.huge_pages && size >= huge_page_size)
+        // Memory from mmap() is already zeroed.
+        return map_huge_pages(round_to_huge_pages(size), alignment);
+    else
+        return allocate_large(size, alignment, zeroed);
+}
+
+void deallocate_impl(pool_state& pool, void* ptr, std::size_t size)
+{
+    if (size <= max_size_class)
+        pool.deallocate(ptr, size_class_index(size));
+    else if (pool.huge_pages && size >= huge_page_size)
+        munmap(ptr, round_to_huge_pages(size));
+    else
+        std::free(ptr);
+}
+} // namespace
+
+void* clauf::pool::allocate(std::size_t size, std::size_t alignment)
+{
+    return allocate_impl(thread_pool, size, alignment, false);
+}
+
+void* clauf::pool::allocate_zeroed(std::size_t size, std::size_t alignment)
+{
+    return allocate_impl(thread_pool, size, alignment, true);
+}
+
+void clauf::pool::deallocate(void* ptr, std::size_t size)
+{
+    deallocate_impl(thread_pool, ptr, size);
+}
+
+bool clauf::pool::can_resize_in_place(std::size_t old_size, std::size_t new_size)
+{
+    return old_size <= max_size_class && new_size <= max_size_class
+           && size_class_index(old_size) == size_class_index(new_size);
+}
+
+//=== heap ===//
+namespace
+{
+// Memory of the arena heap is allocated in blocks of that size.
+constexpr auto heap_arena_block_size = std::size_t(1024) * 1024;
+
+struct heap_arena
+{
+    std::vector<void*> blocks;
+    char*              cur = nullptr;
+    char*              end = nullptr;
+
+    ~heap_arena()
+    {
+        release();
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        auto aligned = reinterpret_cast<char*>(
+            (reinterpret_cast<std::uintptr_t>(cur) + alignment - 1) & ~(alignment - 1));
+        if (cur == nullptr || aligned > end || std::size_t(end - aligned) < size)
+        {
+            auto block_size = std::max(size + alignment, heap_arena_block_size);
+            auto block      = std::malloc(block_size);
+            if (block == nullptr)
+                return nullptr;
+            blocks.push_back(block);
+
+            cur     = static_cast<char*>(block);
+            end     = cur + block_size;
+            aligned = reinterpret_cast<char*>(
+                (reinterpret_cast<std::uintptr_t>(cur) + alignment - 1) & ~(alignment - 1));
+        }
+
+        cur = aligned + size;
+        return aligned;
+    }
+
+    void release()
+    {
+        for (auto block : blocks)
+            std::free(block);
+        blocks.clear();
+        cur = end = nullptr;
+    }
+};
+
+struct heap_state
+{
+    clauf::heap_allocator   allocator = clauf::heap_allocator::pool;
+    heap_arena              arena;
+    clauf::heap::statistics stats;
+    // The memory vm_allocator() has handed out.
+    // When a process exits, lauf also frees the live heap blocks of the program through it, which
+    // were allocated by calling allocate() directly and must not be counted.
+    std::unordered_set<void*> vm_blocks;
+} heap_state;
+
+void* heap_allocate(std::size_t size, std::size_t alignment, bool zeroed)
+{
+    void* result = nullptr;
+    switch (heap_state.allocator)
+    {
+    case clauf::heap_allocator::pool:
+        result = allocate_impl(thread_pool, size, alignment, zeroed);
+        break;
+    case clauf::heap_allocator::malloc:
+        result = allocate_large(size, alignment, zeroed);
+        break;
+    case clauf::heap_allocator::arena:
+        result = heap_state.arena.allocate(size, alignment);
+        if (result != nullptr && zeroed)
+            std::memset(result, 0, size);
+        break;
+    case clauf::heap_allocator::hugepage:
+        result = allocate_impl(thread_huge_pool, size, alignment, zeroed);
+        break;
+    }
+    return result;
+}
+} // namespace
+
+void clauf::heap::select(heap_allocator allocator)
+{
+    heap_state.allocator = allocator;
+}
+
+const lauf_vm_allocator& clauf::heap::vm_allocator()
+{
+    static const lauf_vm_allocator result
+        = {nullptr,
+           [](void*, std::size_t size, std::size_t alignment) {
+               auto result = heap::allocate(size, alignment);
+               if (result != nullptr)
+               {
+                   heap_state.vm_blocks.insert(result);
+
+                   auto& stats = heap_state.stats;
+                   ++stats.allocations;
+                   stats.current_bytes += size;
+                   stats.peak_bytes = std::max(stats.peak_bytes, stats.current_bytes);
+               }
+               return result;
+           },
+           [](void*, void* ptr, std::size_t size) {
+               heap::deallocate(ptr, size);
+               if (heap_state.vm_blocks.erase(ptr) == 0)
+                   return;
+
+               auto& stats = heap_state.stats;
+               ++stats.deallocations;
+               stats.current_bytes -= size;
+           }};
+    return result;
+}
+
+void* clauf::heap::allocate(std::size_t size, std::size_t alignment)
+{
+    return heap_allocate(size, alignment, false);
+}
+
+void* clauf::heap::allocate_zeroed(std::size_t size, std::size_t alignment)
+{
+    return heap_allocate(size, alignment, true);
+}
+
+void clauf::heap::deallocate(void* ptr, std::size_t size)
+{
+    switch (heap_state.allocator)
+    {
+    case heap_allocator::pool:
+        deallocate_impl(thread_pool, ptr, size);
+        break;
+    case heap_allocator::malloc:
+        std::free(ptr);
+        break;
+    case heap_allocator::arena:
+        // Memory is only freed by release().
+        break;
+    case heap_allocator::hugepage:
+        deallocate_impl(thread_huge_pool, ptr, size);
+        break;
+    }
+}
+
+bool clauf::heap::can_resize_in_place(std::size_t old_size, std::size_t new_size)
+{
+    switch (heap_state.allocator)
+    {
+    case heap_allocator::pool:
+    case heap_allocator::hugepage:
+        return pool::can_resize_in_place(old_size, new_size);
+    case heap_allocator::malloc:
+    case heap_allocator::arena:
+        return false;
+    }
+    return false;
+}
+
+void clauf::heap::release()
+{
+    if (heap_state.allocator == heap_allocator::arena)
+        heap_state.arena.release();
+}
+
+const clauf::heap::statistics& clauf::heap::stats()
+{
+    return heap_state.stats;
+}
+
+//=== arena ===//
+namespace
+{
+constexpr auto arena_block_size = std::size_t(64) * 1024;
+}
+
+clauf::arena::~arena()
+{
+    for (auto block : _blocks)
+        std::free(block.memory);
+}
+
+void* clauf::arena::allocate(std::size_t size)
+{
+    // Every allocation is a multiple of the alignment, so the next one is aligned as well.
+    constexpr auto alignment = alignof(std::max_align_t);
+    size                     = (std::max(size, std::size_t(1)) + alignment - 1) & ~(alignment - 1);
+
+    if (std::size_t(_end - _cur) < size)
+    {
+        auto block_size = std::max(size, arena_block_size);
+        auto memory     = static_cast<char*>(std::malloc(block_size));
+        if (memory == nullptr)
+            return nullptr;
+        _blocks.push_back({memory, block_size});
+
+        _cur = memory;
+        _end = memory + block_size;
+    }
+
+    auto result = _cur;
+    _cur += size;
+    return result;
+}
+
+void clauf::arena::reset()
+{
+    if (_blocks.empty())
+        return;
+
+    for (auto iter = std::next(_blocks.begin()); iter != _blocks.end(); ++iter)
+        std::free(iter->memory);
+    _blocks.resize(1);
+
+    _cur = _blocks.front().memory;
+    _end = _cur + _blocks.front().size;
+}
@@ -346,6 +346,84 @@ bool clauf::is_nullptr_constant(const expr* e)
     }
 }
 
+std::optional<std::vector<clauf::format_directive>> clauf::parse_format_string(const char* format)
+{
+    std::vector<format_directive> result;
+    auto add_literal = [&](char c) {
+        if (result.empty() || result.back().kind != format_directive::literal)
+            result.push_back({format_directive::literal, {}});
+        result.back().text.push_back(c);
+    };
+
+    auto cur = format;
+    while (*cur != '\0')
+    {
+        if (*cur != '%')
+        {
+            add_literal(*cur);
+            ++cur;
+            continue;
+        }
+        ++cur;
+
+        if (*cur == '%')
+        {
+            add_literal('%');
+            ++cur;
+            continue;
+        }
+
+        format_directive directive{format_directive::literal, {}};
+        while (*cur == '-' || *cur == '0')
+        {
+            if (*cur == '-')
+                directive.left_align = true;
+            else
+                directive.zero_pad = true;
+            ++cur;
+        }
+        while (*cur >= '0' && *cur <= '9')
+        {
+            directive.width = directive.width * 10 + unsigned(*cur - '0');
+            ++cur;
+        }
+
+        switch (*cur)
+        {
+        case 'd':
+        case 'i':
+            directive.kind = format_directive::sint;
+            break;
+        case 'u':
+            directive.kind = format_directive::uint;
+            break;
+        case 'x':
+            directive.kind = format_directive::hex;
+            break;
+        case 'X':
+            directive.kind = format_directive::hex_upper;
+            break;
+        case 'c':
+            directive.kind = format_directive::char_;
+            break;
+        case 's':
+            directive.kind = format_directive::string;
+            break;
+        default:
+            return std::nullopt;
+        }
+        ++cur;
+
+        // The `0` flag is ignored if `-` is present or for non-numeric conversions.
+        if (directive.left_align || directive.kind == format_directive::char_
+            || directive.kind == format_directive::string)
+            directive.zero_pad = false;
+        result.push_back(directive);
+    }
+
+    return result;
+}
+
 bool clauf::is_named_constant(const expr* e)
 {
     if (auto id = dryad::node_try_cast<identifier_expr>(e))
@@ -716,6 +794,9 @@ void clauf::dump_type(const ast_symbol_interner& symbols, const clauf::type* ty)
             case native_specifier::string:
                 std::printf("native_string");
                 break;
+            case native_specifier::buffer:
+                std::printf("native_buffer");
+                break;
             }
             std::printf(" ");
         },
@@ -800,6 +881,105 @@ void clauf::dump_ast(const ast& ast)
                 case builtin_expr::free:
                     std::printf("__clauf_free");
                     break;
+                case builtin_expr::realloc:
+                    std::printf("__clauf_realloc");
+                    break;
+                case builtin_expr::calloc:
+                    std::printf("__clauf_calloc");
+                    break;
+                case builtin_expr::arena_create:
+                    std::printf("__clauf_arena_create");
+                    break;
+                case builtin_expr::arena_alloc:
+                    std::printf("__clauf_arena_alloc");
+                    break;
+                case builtin_expr::arena_reset:
+                    std::printf("__clauf_arena_reset");
+                    break;
+                case builtin_expr::arena_destroy:
+                    std::printf("__clauf_arena_destroy");
+                    break;
+                case builtin_expr::printf:
+                    std::printf("__clauf_printf");
+                    break;
+                case builtin_expr::sprintf:
+                    std::printf("__clauf_sprintf");
+                    break;
+                case builtin_expr::puts:
+                    std::printf("__clauf_puts");
+                    break;
+                case builtin_expr::map_file:
+                    std::printf("__clauf_map_file");
+                    break;
+                case builtin_expr::unmap_file:
+                    std::printf("__clauf_unmap_file");
+                    break;
+                case builtin_expr::map_create:
+                    std::printf("__clauf_map_create");
+                    break;
+                case builtin_expr::map_destroy:
+                    std::printf("__clauf_map_destroy");
+                    break;
+                case builtin_expr::map_size:
+                    std::printf("__clauf_map_size");
+                    break;
+                case builtin_expr::map_insert:
+                    std::printf("__clauf_map_insert");
+                    break;
+                case builtin_expr::map_find:
+                    std::printf("__clauf_map_find");
+                    break;
+                case builtin_expr::map_erase:
+                    std::printf("__clauf_map_erase");
+                    break;
+                case builtin_expr::map_insert_bytes:
+                    std::printf("__clauf_map_insert_bytes");
+                    break;
+                case builtin_expr::map_find_bytes:
+                    std::printf("__clauf_map_find_bytes");
+                    break;
+                case builtin_expr::map_erase_bytes:
+                    std::printf("__clauf_map_erase_bytes");
+                    break;
+                case builtin_expr::vector_create:
+                    std::printf("__clauf_vector_create");
+                    break;
+                case builtin_expr::vector_destroy:
+                    std::printf("__clauf_vector_destroy");
+                    break;
+                case builtin_expr::vector_size:
+                    std::printf("__clauf_vector_size");
+                    break;
+                case builtin_expr::vector_push:
+                    std::printf("__clauf_vector_push");
+                    break;
+                case builtin_expr::vector_pop:
+                    std::printf("__clauf_vector_pop");
+                    break;
+                case builtin_expr::vector_get:
+                    std::printf("__clauf_vector_get");
+                    break;
+                case builtin_expr::vector_set:
+                    std::printf("__clauf_vector_set");
+                    break;
+                case builtin_expr::sort:
+                    std::printf("__clauf_sort");
+                    break;
+                case builtin_expr::io_submit_read:
+                    std::printf("__clauf_io_submit_read");
+                    break;
+                case builtin_expr::io_submit_write:
+                    std::printf("__clauf_io_submit_write");
+                    break;
+                case builtin_expr::io_wait:
+                    std::printf("__clauf_io_wait");
+                    break;
+                case builtin_expr::bench:
+                    std::printf("__clauf_bench");
+                    break;
+                case builtin_expr::now_ns:
+                    std::printf("__clauf_now_ns");
+                    break;
                 }
             },
             [&](const identifier_expr* expr) {
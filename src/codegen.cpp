@@ -3,16 +3,21 @@
 
 #include <clauf/codegen.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <dlfcn.h>
 #include <dryad/node_map.hpp>
+#include <fcntl.h>
 #include <ffi.h>
 #include <lauf/asm/builder.h>
 #include <lauf/asm/program.h>
 #include <lauf/asm/type.h>
 #include <lauf/lib/bits.h>
 #include <lauf/lib/debug.h>
-#include <lauf/lib/heap.h>
 #include <lauf/lib/int.h>
 #include <lauf/lib/memory.h>
 #include <lauf/lib/test.h>
@@ -20,13 +25,24 @@
 #include <lauf/runtime/memory.h>
 #include <lauf/runtime/process.h>
 #include <lauf/runtime/value.h>
-#include <lexy/input_location.hpp>
+#include <map>
 #include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <clauf/allocator.hpp>
 #include <clauf/assert.hpp>
 #include <clauf/ast.hpp>
+#include <clauf/containers.hpp>
 #include <clauf/diagnostic.hpp>
+#include <clauf/io.hpp>
+#include <clauf/sort.hpp>
 
 //=== helper functions ===//
 namespace
@@ -103,7 +119,7 @@ lauf_asm_layout codegen_lauf_layout(const clauf::type* ty)
     }
 }
 
-ffi_type* codegen_ffi_type(const clauf::type* ty)
+ffi_type* codegen_ffi_type(clauf::code& code, const clauf::type* ty)
 {
     return dryad::visit_node_all(
         ty,
@@ -143,7 +159,39 @@ ffi_type* codegen_ffi_type(const clauf::type* ty)
             CLAUF_UNREACHABLE("function cannot be passed as function parameter");
             return nullptr;
         },
-        [](const clauf::qualified_type* ty) { return codegen_ffi_type(ty->unqualified_type()); });
+        [&](const clauf::qualified_type* ty) {
+            return codegen_ffi_type(code, ty->unqualified_type());
+        },
+        [&](const clauf::decl_type* ty) {
+            auto decl = dryad::node_cast<clauf::struct_decl>(ty->decl()->definition());
+            if (auto cached = code.lookup_ffi_struct_type(decl))
+                return &cached->type;
+
+            // libffi doesn't have arrays, so we flatten them into their elements.
+            clauf::ffi_struct_type result;
+            result.decl = decl;
+            auto add_element = [&](auto self, const clauf::type* member_ty) -> void {
+                if (auto array = dryad::node_try_cast<clauf::array_type>(
+                        clauf::unqualified_type_of(member_ty)))
+                {
+                    for (auto i = 0u; i != array->size(); ++i)
+                        self(self, array->element_type());
+                }
+                else
+                {
+                    result.elements.push_back(codegen_ffi_type(code, member_ty));
+                }
+            };
+            for (auto member : decl->members())
+                add_element(add_element, member->type());
+            result.elements.push_back(nullptr);
+
+            // libffi computes size and alignment.
+            result.type.size      = 0;
+            result.type.alignment = 0;
+            result.type.type      = FFI_TYPE_STRUCT;
+            return &code.add_ffi_struct_type(std::move(result))->type;
+        });
 }
 
 template <typename Op, typename Expr>
@@ -265,6 +313,59 @@ void call_arithmetic_builtin(lauf_asm_builder* b, Op op, const Expr* expr)
     }
 }
 
+//=== buffered output ===//
+// The output of the printf builtins is collected in a buffer and only written when it is full or
+// when the program exits.
+// Anything else that writes to stdout needs to flush it first to preserve the order.
+struct output_buffer
+{
+    static constexpr auto capacity = std::size_t(64) * 1024;
+
+    std::string buffer;
+
+    output_buffer()
+    {
+        buffer.reserve(capacity);
+    }
+
+    output_buffer(const output_buffer&)            = delete;
+    output_buffer& operator=(const output_buffer&) = delete;
+
+    ~output_buffer()
+    {
+        flush();
+    }
+
+    void flush()
+    {
+        if (buffer.empty())
+            return;
+
+        std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+        std::fflush(stdout);
+        buffer.clear();
+    }
+
+    void flush_if_full()
+    {
+        if (buffer.size() >= capacity)
+            flush();
+    }
+} output_buffer;
+
+// Returns the address of the native function, looking it up on the first call.
+// Returns nullptr if the function does not exist.
+void* resolve_native_function(clauf::ffi_function& fn)
+{
+    if (fn.addr == nullptr)
+        fn.addr = fn.libraries->lookup(fn.name.c_str());
+    return fn.addr;
+}
+
+// Set when an interpreted function called from native code panics.
+// We can't unwind through the native code, so we propagate the panic once it returns.
+thread_local bool native_callback_panicked = false;
+
 void* argument_ptrs[32];
 
 // This builtin takes two arguments:
@@ -277,20 +378,204 @@ LAUF_RUNTIME_BUILTIN(call_native, 3, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "call_nati
     auto argument_array_address = vstack_ptr[1].as_address;
     auto return_address         = vstack_ptr[2].as_address;
 
-    CLAUF_ASSERT(ffi_function->cif.nargs < 32, "too many arguments");
+    if (resolve_native_function(*ffi_function) == nullptr)
+        return lauf_runtime_panic(process, "undefined reference to native function");
+    if (!ffi_function->cif_prepared)
+    {
+        ffi_prep_cif(&ffi_function->cif, FFI_DEFAULT_ABI,
+                     unsigned(ffi_function->argument_types.size()), ffi_function->return_type,
+                     ffi_function->argument_types.data());
+        ffi_function->cif_prepared = true;
+    }
+
+    // Structs are passed by pointing directly to their memory, so we need to validate the entire
+    // object.
+    auto& cif = ffi_function->cif;
+    CLAUF_ASSERT(cif.nargs < 32, "too many arguments");
     auto argument_addresses = static_cast<lauf_runtime_value*>(
         lauf_runtime_get_mut_ptr(process, argument_array_address, {1, 1}));
-    for (auto i = 0u; i != ffi_function->cif.nargs; ++i)
-        argument_ptrs[i]
-            = lauf_runtime_get_mut_ptr(process, argument_addresses[i].as_address, {1, 1});
+    for (auto i = 0u; i != cif.nargs; ++i)
+    {
+        argument_ptrs[i] = lauf_runtime_get_mut_ptr(process, argument_addresses[i].as_address,
+                                                    {cif.arg_types[i]->size, 1});
+        if (argument_ptrs[i] == nullptr)
+            return lauf_runtime_panic(process, "invalid address");
+    }
+
+    // libffi writes at least a full register for scalar results.
+    void* return_ptr = nullptr;
+    if (cif.rtype->type != FFI_TYPE_VOID)
+    {
+        auto return_size = cif.rtype->type == FFI_TYPE_STRUCT
+                               ? cif.rtype->size
+                               : std::max(cif.rtype->size, sizeof(ffi_arg));
+        return_ptr = lauf_runtime_get_mut_ptr(process, return_address, {return_size, 1});
+        if (return_ptr == nullptr)
+            return lauf_runtime_panic(process, "invalid address");
+    }
 
-    ffi_call(&ffi_function->cif, reinterpret_cast<void (*)()>(ffi_function->addr),
-             lauf_runtime_get_mut_ptr(process, return_address, {1, 1}), argument_ptrs);
+    output_buffer.flush();
+    ffi_call(&cif, reinterpret_cast<void (*)()>(ffi_function->addr), return_ptr, argument_ptrs);
+    if (std::exchange(native_callback_panicked, false))
+        return lauf_runtime_panic(process, "panic in native callback");
 
     vstack_ptr += 3;
     LAUF_RUNTIME_BUILTIN_DISPATCH;
 }
 
+//=== direct native calls ===//
+// Most native functions only take and return integers and pointers.
+// Those can be called without going through libffi: on the ABIs we care about, integer and pointer
+// arguments are passed in general purpose registers.
+// So we can call the function through a pointer that takes all arguments as 64 bit integers,
+// once the trampoline has truncated and extended them to their actual type (see
+// codegen_native_argument_truncation()); the return value is truncated here.
+constexpr auto max_direct_native_arguments = 6u;
+
+template <typename Return, std::size_t... Idx>
+Return invoke_native_direct(void* addr, const lauf_runtime_value* arguments,
+                            std::index_sequence<Idx...>)
+{
+    using fn_ptr = Return (*)(decltype((void)Idx, std::uint64_t())...);
+    // The first argument is the one furthest from the top of the vstack.
+    return reinterpret_cast<fn_ptr>(addr)(arguments[sizeof...(Idx) - 1 - Idx].as_uint...);
+}
+
+// vstack_ptr[0] is the ffi_function (whose address is addr), below it are the Arity arguments.
+// Returns the vstack_ptr after the call.
+template <std::size_t Arity, typename Return>
+lauf_runtime_value* call_native_direct(void* addr, lauf_runtime_value* vstack_ptr)
+{
+    auto arguments = vstack_ptr + 1;
+
+    if constexpr (std::is_void_v<Return>)
+    {
+        invoke_native_direct<void>(addr, arguments, std::make_index_sequence<Arity>{});
+        return vstack_ptr + Arity + 1;
+    }
+    else
+    {
+        auto result
+            = invoke_native_direct<Return>(addr, arguments, std::make_index_sequence<Arity>{});
+
+        vstack_ptr += Arity;
+        if constexpr (std::is_signed_v<Return>)
+            vstack_ptr[0].as_sint = result;
+        else
+            vstack_ptr[0].as_uint = result;
+        return vstack_ptr;
+    }
+}
+
+enum class native_return_kind
+{
+    void_,
+    sint8,
+    uint8,
+    sint16,
+    uint16,
+    sint32,
+    uint32,
+    // 64 bit integers and pointers.
+    word,
+
+    _count,
+};
+
+#define CLAUF_NATIVE_DIRECT_BUILTIN(Arity, Kind, Return, OutputCount)                              \
+    LAUF_RUNTIME_BUILTIN(call_native_##Arity##_##Kind, Arity + 1, OutputCount,                     \
+                         LAUF_RUNTIME_BUILTIN_DEFAULT, "call_native_" #Arity "_" #Kind, nullptr)   \
+    {                                                                                              \
+        auto fn = static_cast<clauf::ffi_function*>(vstack_ptr[0].as_native_ptr);                  \
+        auto addr = resolve_native_function(*fn);                                                  \
+        if (addr == nullptr)                                                                       \
+            return lauf_runtime_panic(process, "undefined reference to native function");          \
+        output_buffer.flush();                                                                     \
+        vstack_ptr = call_native_direct<Arity, Return>(addr, vstack_ptr);                          \
+        if (std::exchange(native_callback_panicked, false))                                        \
+            return lauf_runtime_panic(process, "panic in native callback");                        \
+        LAUF_RUNTIME_BUILTIN_DISPATCH;                                                             \
+    }
+
+#define CLAUF_NATIVE_DIRECT_BUILTINS(Arity)                                                        \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, void_, void, 0)                                             \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, sint8, std::int8_t, 1)                                      \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, uint8, std::uint8_t, 1)                                     \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, sint16, std::int16_t, 1)                                    \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, uint16, std::uint16_t, 1)                                   \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, sint32, std::int32_t, 1)                                    \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, uint32, std::uint32_t, 1)                                   \
+    CLAUF_NATIVE_DIRECT_BUILTIN(Arity, word, std::uint64_t, 1)
+
+#define CLAUF_NATIVE_DIRECT_BUILTINS_ROW(Arity)                                                    \
+    {                                                                                              \
+        &call_native_##Arity##_void_, &call_native_##Arity##_sint8,                                \
+            &call_native_##Arity##_uint8, &call_native_##Arity##_sint16,                           \
+            &call_native_##Arity##_uint16, &call_native_##Arity##_sint32,                          \
+            &call_native_##Arity##_uint32, &call_native_##Arity##_word                             \
+    }
+
+CLAUF_NATIVE_DIRECT_BUILTINS(0)
+CLAUF_NATIVE_DIRECT_BUILTINS(1)
+CLAUF_NATIVE_DIRECT_BUILTINS(2)
+CLAUF_NATIVE_DIRECT_BUILTINS(3)
+CLAUF_NATIVE_DIRECT_BUILTINS(4)
+CLAUF_NATIVE_DIRECT_BUILTINS(5)
+CLAUF_NATIVE_DIRECT_BUILTINS(6)
+
+// Indexed by arity and native_return_kind.
+constexpr auto native_return_kind_count = std::size_t(native_return_kind::_count);
+const lauf_runtime_builtin* const
+    call_native_direct_builtins[max_direct_native_arguments + 1][native_return_kind_count]
+    = {CLAUF_NATIVE_DIRECT_BUILTINS_ROW(0), CLAUF_NATIVE_DIRECT_BUILTINS_ROW(1),
+       CLAUF_NATIVE_DIRECT_BUILTINS_ROW(2), CLAUF_NATIVE_DIRECT_BUILTINS_ROW(3),
+       CLAUF_NATIVE_DIRECT_BUILTINS_ROW(4), CLAUF_NATIVE_DIRECT_BUILTINS_ROW(5),
+       CLAUF_NATIVE_DIRECT_BUILTINS_ROW(6)};
+
+#undef CLAUF_NATIVE_DIRECT_BUILTINS_ROW
+#undef CLAUF_NATIVE_DIRECT_BUILTINS
+#undef CLAUF_NATIVE_DIRECT_BUILTIN
+
+// Native functions are often called with the same string over and over again.
+// Instead of validating it every time, we remember its length: if the memory up to that length is
+// still valid and still null-terminated, native code cannot read past it.
+struct string_length_cache
+{
+    static constexpr auto max_entries = std::size_t(4096);
+
+    // The cache is only valid for a single process.
+    lauf_runtime_process*                          process = nullptr;
+    std::unordered_map<std::uint64_t, std::size_t> lengths;
+
+    const char* get(lauf_runtime_process* cur_process, lauf_runtime_value address)
+    {
+        if (cur_process != process)
+        {
+            process = cur_process;
+            lengths.clear();
+        }
+
+        // We use the bit representation of the address as the key.
+        if (auto iter = lengths.find(address.as_uint); iter != lengths.end())
+        {
+            auto length = iter->second;
+            auto ptr    = static_cast<const char*>(
+                lauf_runtime_get_const_ptr(process, address.as_address, {length + 1, 1}));
+            if (ptr != nullptr && ptr[length] == '\0')
+                return ptr;
+        }
+
+        auto ptr = lauf_runtime_get_cstr(process, address.as_address);
+        if (ptr != nullptr)
+        {
+            if (lengths.size() == max_entries)
+                lengths.clear();
+            lengths.insert_or_assign(address.as_uint, std::strlen(ptr));
+        }
+        return ptr;
+    }
+} string_length_cache;
+
 // Translates a lauf address into the native pointer representation.
 // It takes one argument, which is the address, and returns one argument, which is the pointer.
 LAUF_RUNTIME_BUILTIN(translate_address_to_pointer, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
@@ -309,24 +594,125 @@ LAUF_RUNTIME_BUILTIN(translate_address_to_pointer, 1, 1, LAUF_RUNTIME_BUILTIN_DE
 LAUF_RUNTIME_BUILTIN(translate_address_to_string, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
                      "translate_address_to_string", &translate_address_to_pointer)
 {
-    auto address = vstack_ptr[0].as_address;
-
-    auto ptr = lauf_runtime_get_cstr(process, address);
+    auto ptr = string_length_cache.get(process, vstack_ptr[0]);
     if (ptr == nullptr)
         return lauf_runtime_panic(process, "invalid address");
     vstack_ptr[0].as_native_ptr = (void*)ptr;
 
     LAUF_RUNTIME_BUILTIN_DISPATCH;
 }
+// As above, but translates to a buffer whose entire range is validated.
+// It takes two arguments, the address and the size of the buffer in bytes.
+LAUF_RUNTIME_BUILTIN(translate_address_to_buffer, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "translate_address_to_buffer", &translate_address_to_string)
+{
+    auto size    = vstack_ptr[0].as_uint;
+    auto address = vstack_ptr[1].as_address;
+    ++vstack_ptr;
+
+    auto ptr = lauf_runtime_get_mut_ptr(process, address, {size, 1});
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "invalid buffer");
+    vstack_ptr[0].as_native_ptr = ptr;
 
-// Translates a native pointer back to a lauf address.
-LAUF_RUNTIME_BUILTIN(translate_pointer_to_address, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
-                     "translate_pointer_to_address", &translate_address_to_string)
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(translate_address_to_const_buffer, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "translate_address_to_const_buffer", &translate_address_to_buffer)
 {
-    auto ptr = vstack_ptr[0].as_native_ptr;
+    auto size    = vstack_ptr[0].as_uint;
+    auto address = vstack_ptr[1].as_address;
+    ++vstack_ptr;
 
-    auto address             = lauf_runtime_add_static_mut_allocation(process, ptr, size_t(-1));
-    vstack_ptr[0].as_address = address;
+    auto ptr = lauf_runtime_get_const_ptr(process, address, {size, 1});
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "invalid buffer");
+    vstack_ptr[0].as_native_ptr = (void*)ptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+// Native pointers returned to lauf need an allocation so lauf can access them.
+// Native functions frequently return the same pointer or pointers into the same object,
+// so we remember the allocations we've created and re-use them instead of adding new ones.
+struct native_allocation_cache
+{
+    static constexpr auto unknown_size = std::size_t(-1);
+
+    struct entry
+    {
+        std::size_t          size;
+        lauf_runtime_address address;
+    };
+
+    // The cache is only valid for a single process.
+    lauf_runtime_process*                 process = nullptr;
+    std::map<const unsigned char*, entry> entries;
+
+    lauf_runtime_address get(lauf_runtime_process* cur_process, void* native_ptr, std::size_t size)
+    {
+        if (cur_process != process)
+        {
+            // The allocations of the previous process are gone, so are the mappings.
+            process = cur_process;
+            entries.clear();
+        }
+
+        auto ptr = static_cast<const unsigned char*>(native_ptr);
+        if (auto iter = entries.upper_bound(ptr); iter != entries.begin())
+        {
+            --iter;
+            auto [base, cached] = *iter;
+            // The cached allocation can be re-used if it contains the entire range.
+            // If we don't know the size of the cached allocation, we can only re-use it for the
+            // exact same pointer.
+            auto offset   = std::size_t(ptr - base);
+            auto contains = [&] {
+                if (cached.size == unknown_size)
+                    return offset == 0;
+                else
+                    return size != unknown_size && offset <= cached.size
+                           && size <= cached.size - offset;
+            }();
+            // The program might have freed the allocation since, so check it is still there.
+            if (contains && lauf_runtime_get_const_ptr(process, cached.address, {0, 1}) == base)
+            {
+                auto result   = cached.address;
+                result.offset = std::uint32_t(result.offset + offset);
+                return result;
+            }
+        }
+
+        auto address = lauf_runtime_add_static_mut_allocation(process, native_ptr, size);
+        entries.insert_or_assign(ptr, entry{size, address});
+        return address;
+    }
+
+    lauf_runtime_address get_string(lauf_runtime_process* cur_process, char* str)
+    {
+        // If we've returned the same string before and it is still null-terminated at the same
+        // position, we don't need to compute the length again.
+        if (cur_process == process)
+            if (auto iter = entries.find(reinterpret_cast<const unsigned char*>(str));
+                iter != entries.end() && iter->second.size != unknown_size
+                && iter->second.size > 0 && str[iter->second.size - 1] == '\0')
+                return get(cur_process, str, iter->second.size);
+
+        return get(cur_process, str, std::strlen(str) + 1);
+    }
+} native_allocation_cache;
+
+// Translates a native pointer into a lauf address.
+// It takes two arguments, the pointer and the size of the object it points to, which might be
+// unknown (-1); it returns the address.
+LAUF_RUNTIME_BUILTIN(translate_pointer_to_address, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "translate_pointer_to_address", &translate_address_to_const_buffer)
+{
+    auto size = vstack_ptr[0].as_uint;
+    auto ptr  = vstack_ptr[1].as_native_ptr;
+    ++vstack_ptr;
+
+    vstack_ptr[0].as_address = native_allocation_cache.get(process, ptr, size);
 
     LAUF_RUNTIME_BUILTIN_DISPATCH;
 }
@@ -335,8 +721,1646 @@ LAUF_RUNTIME_BUILTIN(translate_string_to_address, 1, 1, LAUF_RUNTIME_BUILTIN_DEF
 {
     auto ptr = static_cast<char*>(vstack_ptr[0].as_native_ptr);
 
-    auto address = lauf_runtime_add_static_mut_allocation(process, ptr, std::strlen(ptr) + 1);
-    vstack_ptr[0].as_address = address;
+    vstack_ptr[0].as_address = native_allocation_cache.get_string(process, ptr);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== native callbacks ===//
+lauf_runtime_value translate_native_argument(lauf_runtime_process* process, const ffi_type* type,
+                                             std::size_t size, void* argument)
+{
+    lauf_runtime_value result;
+    switch (type->type)
+    {
+    case FFI_TYPE_SINT8:
+        result.as_sint = *static_cast<std::int8_t*>(argument);
+        break;
+    case FFI_TYPE_UINT8:
+        result.as_uint = *static_cast<std::uint8_t*>(argument);
+        break;
+    case FFI_TYPE_SINT16:
+        result.as_sint = *static_cast<std::int16_t*>(argument);
+        break;
+    case FFI_TYPE_UINT16:
+        result.as_uint = *static_cast<std::uint16_t*>(argument);
+        break;
+    case FFI_TYPE_SINT32:
+        result.as_sint = *static_cast<std::int32_t*>(argument);
+        break;
+    case FFI_TYPE_UINT32:
+        result.as_uint = *static_cast<std::uint32_t*>(argument);
+        break;
+    case FFI_TYPE_SINT64:
+        result.as_sint = *static_cast<std::int64_t*>(argument);
+        break;
+    case FFI_TYPE_UINT64:
+        result.as_uint = *static_cast<std::uint64_t*>(argument);
+        break;
+    case FFI_TYPE_POINTER:
+        result.as_address
+            = native_allocation_cache.get(process, *static_cast<void**>(argument), size);
+        break;
+    case FFI_TYPE_STRUCT:
+        // Structs are passed by pointer, so we can point directly to libffi's copy.
+        result.as_address = native_allocation_cache.get(process, argument, type->size);
+        break;
+    default:
+        CLAUF_UNREACHABLE("unsupported callback argument");
+        break;
+    }
+    return result;
+}
+
+// The function libffi calls when native code calls a closure.
+void call_native_callback(ffi_cif*, void* result, void** arguments, void* user_data)
+{
+    auto  closure  = static_cast<clauf::native_callback::closure*>(user_data);
+    auto& callback = *closure->callback;
+    auto  process  = closure->process;
+
+    std::vector<lauf_runtime_value> inputs;
+    if (callback.return_type->type == FFI_TYPE_STRUCT)
+    {
+        // The function writes the struct directly into libffi's result storage.
+        lauf_runtime_value return_ptr;
+        return_ptr.as_address
+            = native_allocation_cache.get(process, result, callback.return_type->size);
+        inputs.push_back(return_ptr);
+    }
+    for (auto i = 0u; i != callback.argument_types.size(); ++i)
+        inputs.push_back(translate_native_argument(process, callback.argument_types[i],
+                                                   callback.argument_sizes[i], arguments[i]));
+
+    lauf_runtime_value output;
+    output.as_uint = 0;
+
+    auto fn = lauf_runtime_get_function_ptr(process, closure->function, callback.signature);
+    if (fn == nullptr || !lauf_runtime_call(process, fn, inputs.data(), &output))
+    {
+        native_callback_panicked = true;
+        output.as_uint           = 0;
+    }
+
+    switch (callback.return_type->type)
+    {
+    case FFI_TYPE_VOID:
+    case FFI_TYPE_STRUCT:
+        break;
+    case FFI_TYPE_SINT8:
+    case FFI_TYPE_SINT16:
+    case FFI_TYPE_SINT32:
+    case FFI_TYPE_SINT64:
+        // libffi requires integer results to be widened to a full register.
+        *static_cast<ffi_sarg*>(result) = ffi_sarg(output.as_sint);
+        break;
+    case FFI_TYPE_UINT8:
+    case FFI_TYPE_UINT16:
+    case FFI_TYPE_UINT32:
+    case FFI_TYPE_UINT64:
+        *static_cast<ffi_arg*>(result) = ffi_arg(output.as_uint);
+        break;
+    case FFI_TYPE_POINTER:
+        *static_cast<const void**>(result)
+            = native_callback_panicked
+                  ? nullptr
+                  : lauf_runtime_get_const_ptr(process, output.as_address, {0, 1});
+        break;
+    default:
+        CLAUF_UNREACHABLE("unsupported callback return type");
+        break;
+    }
+}
+
+// Returns a native function pointer that calls the interpreted function.
+// Closures are created once per function and signature and then re-used.
+void* get_native_closure(lauf_runtime_process* process, clauf::native_callback& callback,
+                         lauf_runtime_function_address function, std::uint64_t function_bits)
+{
+    if (!callback.cif_prepared)
+    {
+        if (ffi_prep_cif(&callback.cif, FFI_DEFAULT_ABI, unsigned(callback.argument_types.size()),
+                         callback.return_type, callback.argument_types.data())
+            != FFI_OK)
+            return nullptr;
+        callback.cif_prepared = true;
+    }
+
+    auto& closure = callback.closures[function_bits];
+    if (!closure)
+    {
+        void* code = nullptr;
+        auto  ffi  = static_cast<ffi_closure*>(ffi_closure_alloc(sizeof(ffi_closure), &code));
+        if (ffi == nullptr)
+            return nullptr;
+
+        closure           = std::make_unique<clauf::native_callback::closure>();
+        closure->callback = &callback;
+        closure->function = function;
+        closure->code     = code;
+        closure->ffi.reset(ffi);
+        if (ffi_prep_closure_loc(ffi, &callback.cif, &call_native_callback, closure.get(), code)
+            != FFI_OK)
+        {
+            closure.reset();
+            return nullptr;
+        }
+    }
+
+    // The function is called in the process it was passed to native code from.
+    closure->process = process;
+    return closure->code;
+}
+
+// Translates the address of an interpreted function into a native function pointer.
+// It takes two arguments, the function address and the native_callback for its signature.
+LAUF_RUNTIME_BUILTIN(translate_function_to_pointer, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "translate_function_to_pointer", &translate_string_to_address)
+{
+    auto callback = static_cast<clauf::native_callback*>(vstack_ptr[0].as_native_ptr);
+    auto function = vstack_ptr[1];
+    ++vstack_ptr;
+
+    if (lauf_runtime_get_function_ptr(process, function.as_function_address, callback->signature)
+        == nullptr)
+        return lauf_runtime_panic(process, "invalid function address");
+
+    auto ptr = get_native_closure(process, *callback, function.as_function_address,
+                                  function.as_uint);
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "unable to create native callback");
+    vstack_ptr[0].as_native_ptr = ptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== string library ===//
+// Implementations of the string and memory functions of the C standard library.
+// They validate the memory they access once and then call the native implementation, which is
+// vectorized by the C library; unlike calling them through the FFI, no translation of pointers in
+// either direction is necessary.
+// The vstack contains the arguments in order, i.e. the last one is on top.
+
+// Returns the string at address, which needs to be valid for at least max_size characters or up to
+// and including its null terminator.
+const char* get_string_prefix(lauf_runtime_process* process, lauf_runtime_address address,
+                              std::size_t max_size)
+{
+    if (auto ptr = lauf_runtime_get_const_ptr(process, address, {max_size, 1}))
+        return static_cast<const char*>(ptr);
+    else
+        return lauf_runtime_get_cstr(process, address);
+}
+
+// Returns the address of found inside the string or buffer that starts at ptr with the given
+// address.
+lauf_runtime_address make_library_address(lauf_runtime_address address, const void* ptr,
+                                          const void* found)
+{
+    if (found == nullptr)
+        return lauf_runtime_address_null;
+
+    address.offset = std::uint32_t(address.offset
+                                   + std::size_t(static_cast<const char*>(found)
+                                                 - static_cast<const char*>(ptr)));
+    return address;
+}
+
+LAUF_RUNTIME_BUILTIN(library_strlen, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "strlen",
+                     &translate_function_to_pointer)
+{
+    auto str = lauf_runtime_get_cstr(process, vstack_ptr[0].as_address);
+    if (str == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    vstack_ptr[0].as_uint = std::strlen(str);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(library_strcmp, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "strcmp",
+                     &library_strlen)
+{
+    auto rhs = lauf_runtime_get_cstr(process, vstack_ptr[0].as_address);
+    auto lhs = lauf_runtime_get_cstr(process, vstack_ptr[1].as_address);
+    ++vstack_ptr;
+    if (lhs == nullptr || rhs == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    vstack_ptr[0].as_sint = std::strcmp(lhs, rhs);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(library_strncmp, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "strncmp",
+                     &library_strcmp)
+{
+    auto count = vstack_ptr[0].as_uint;
+    auto rhs   = get_string_prefix(process, vstack_ptr[1].as_address, count);
+    auto lhs   = get_string_prefix(process, vstack_ptr[2].as_address, count);
+    vstack_ptr += 2;
+    if (lhs == nullptr || rhs == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    vstack_ptr[0].as_sint = std::strncmp(lhs, rhs, count);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(library_strchr, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "strchr",
+                     &library_strncmp)
+{
+    auto ch      = char(vstack_ptr[0].as_uint);
+    auto address = vstack_ptr[1].as_address;
+    ++vstack_ptr;
+
+    auto str = lauf_runtime_get_cstr(process, address);
+    if (str == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    vstack_ptr[0].as_address = make_library_address(address, str, std::strchr(str, ch));
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(library_strrchr, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "strrchr",
+                     &library_strchr)
+{
+    auto ch      = char(vstack_ptr[0].as_uint);
+    auto address = vstack_ptr[1].as_address;
+    ++vstack_ptr;
+
+    auto str = lauf_runtime_get_cstr(process, address);
+    if (str == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    vstack_ptr[0].as_address = make_library_address(address, str, std::strrchr(str, ch));
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(library_memchr, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "memchr",
+                     &library_strrchr)
+{
+    auto count   = vstack_ptr[0].as_uint;
+    auto ch      = int(static_cast<unsigned char>(vstack_ptr[1].as_uint));
+    auto address = vstack_ptr[2].as_address;
+    vstack_ptr += 2;
+
+    auto ptr = lauf_runtime_get_const_ptr(process, address, {count, 1});
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "invalid buffer");
+
+    vstack_ptr[0].as_address = make_library_address(address, ptr, std::memchr(ptr, ch, count));
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(library_memcmp, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "memcmp",
+                     &library_memchr)
+{
+    auto count = vstack_ptr[0].as_uint;
+    auto rhs   = lauf_runtime_get_const_ptr(process, vstack_ptr[1].as_address, {count, 1});
+    auto lhs   = lauf_runtime_get_const_ptr(process, vstack_ptr[2].as_address, {count, 1});
+    vstack_ptr += 2;
+    if (lhs == nullptr || rhs == nullptr)
+        return lauf_runtime_panic(process, "invalid buffer");
+
+    vstack_ptr[0].as_sint = std::memcmp(lhs, rhs, count);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// memcpy() is implemented as memmove(): it isn't slower and an overlapping copy cannot corrupt
+// the interpreter.
+LAUF_RUNTIME_BUILTIN(library_memmove, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "memmove",
+                     &library_memcmp)
+{
+    auto count = vstack_ptr[0].as_uint;
+    auto src   = lauf_runtime_get_const_ptr(process, vstack_ptr[1].as_address, {count, 1});
+    auto dest  = lauf_runtime_get_mut_ptr(process, vstack_ptr[2].as_address, {count, 1});
+    vstack_ptr += 2;
+    if (dest == nullptr || src == nullptr)
+        return lauf_runtime_panic(process, "invalid buffer");
+
+    // The result is the destination, which is already on top of the vstack.
+    std::memmove(dest, src, count);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(library_memset, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "memset",
+                     &library_memmove)
+{
+    auto count = vstack_ptr[0].as_uint;
+    auto ch    = int(static_cast<unsigned char>(vstack_ptr[1].as_uint));
+    auto dest  = lauf_runtime_get_mut_ptr(process, vstack_ptr[2].as_address, {count, 1});
+    vstack_ptr += 2;
+    if (dest == nullptr)
+        return lauf_runtime_panic(process, "invalid buffer");
+
+    // The result is the destination, which is already on top of the vstack.
+    std::memset(dest, ch, count);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+enum class library_type
+{
+    void_,
+    pointer,
+    // As parameter, both accept any integer type; as return type, the signedness needs to match.
+    int_,
+    size,
+};
+
+struct library_function
+{
+    const char*                 name;
+    const lauf_runtime_builtin* builtin;
+    library_type                return_type;
+    std::size_t                 parameter_count;
+    library_type                parameters[3];
+};
+
+constexpr library_function library_functions[] = {
+    {"strlen", &library_strlen, library_type::size, 1, {library_type::pointer}},
+    {"strcmp",
+     &library_strcmp,
+     library_type::int_,
+     2,
+     {library_type::pointer, library_type::pointer}},
+    {"strncmp",
+     &library_strncmp,
+     library_type::int_,
+     3,
+     {library_type::pointer, library_type::pointer, library_type::size}},
+    {"strchr",
+     &library_strchr,
+     library_type::pointer,
+     2,
+     {library_type::pointer, library_type::int_}},
+    {"strrchr",
+     &library_strrchr,
+     library_type::pointer,
+     2,
+     {library_type::pointer, library_type::int_}},
+    {"memchr",
+     &library_memchr,
+     library_type::pointer,
+     3,
+     {library_type::pointer, library_type::int_, library_type::size}},
+    {"memcmp",
+     &library_memcmp,
+     library_type::int_,
+     3,
+     {library_type::pointer, library_type::pointer, library_type::size}},
+    {"memcpy",
+     &library_memmove,
+     library_type::pointer,
+     3,
+     {library_type::pointer, library_type::pointer, library_type::size}},
+    {"memmove",
+     &library_memmove,
+     library_type::pointer,
+     3,
+     {library_type::pointer, library_type::pointer, library_type::size}},
+    {"memset",
+     &library_memset,
+     library_type::pointer,
+     3,
+     {library_type::pointer, library_type::int_, library_type::size}},
+};
+
+//=== memory report ===//
+// Current and peak usage of one category of memory.
+struct memory_usage
+{
+    std::uint64_t allocations   = 0;
+    std::uint64_t frees         = 0;
+    std::size_t   current_bytes = 0;
+    std::size_t   peak_bytes    = 0;
+
+    void allocated(std::size_t size)
+    {
+        ++allocations;
+        current_bytes += size;
+        peak_bytes = std::max(peak_bytes, current_bytes);
+    }
+
+    void freed(std::size_t size, std::uint64_t count = 1)
+    {
+        frees += count;
+        current_bytes -= std::min(current_bytes, size);
+    }
+};
+
+// Memory usage is always counted, as it is cheap.
+// The live heap blocks and where they were allocated are only tracked if enabled by --mem-report.
+struct memory_report
+{
+    struct block
+    {
+        std::uint64_t site;
+        std::size_t   size;
+    };
+
+    bool enabled = false;
+    // The source locations of the heap allocations in the program; the builtins that allocate
+    // take an index into it.
+    std::vector<std::string> sites;
+
+    memory_usage heap;
+    memory_usage globals;
+    memory_usage arenas;
+    memory_usage file_mappings;
+
+    // The live heap blocks, by the bit representation of their address.
+    // They are only valid for a single process.
+    lauf_runtime_process*                    process = nullptr;
+    std::unordered_map<std::uint64_t, block> blocks;
+
+    void sync(lauf_runtime_process* cur_process)
+    {
+        if (cur_process != process)
+        {
+            process = cur_process;
+            blocks.clear();
+        }
+    }
+
+    void allocated(lauf_runtime_process* cur_process, lauf_runtime_address address,
+                   std::uint64_t site, std::size_t size)
+    {
+        heap.allocated(size);
+        if (!enabled)
+            return;
+
+        sync(cur_process);
+        lauf_runtime_value key;
+        key.as_address      = address;
+        blocks[key.as_uint] = {site, size};
+    }
+
+    void freed(lauf_runtime_process* cur_process, lauf_runtime_address address, std::size_t size)
+    {
+        heap.freed(size);
+        if (!enabled)
+            return;
+
+        sync(cur_process);
+        lauf_runtime_value key;
+        key.as_address = address;
+        blocks.erase(key.as_uint);
+    }
+} memory_report;
+
+//=== heap ===//
+// The VM allocates from clauf::heap, so we can allocate from it directly and hand the memory to
+// lauf as a heap allocation.
+// clauf_free frees the allocation in lauf without freeing its memory, which we return to the heap
+// instead; lauf drops the allocation, so the address stays invalid even if the memory is re-used.
+// The builtins that allocate take the index of the allocation site as last argument.
+constexpr auto heap_alignment = std::size_t(8);
+
+bool is_null(lauf_runtime_address address)
+{
+    return std::memcmp(&address, &lauf_runtime_address_null, sizeof(address)) == 0;
+}
+
+// Takes the size and returns the address of the memory.
+LAUF_RUNTIME_BUILTIN(clauf_malloc, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_malloc",
+                     &library_memset)
+{
+    auto site = vstack_ptr[0].as_uint;
+    auto size = vstack_ptr[1].as_uint;
+    ++vstack_ptr;
+
+    auto ptr = clauf::heap::allocate(size, heap_alignment);
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "out of memory");
+
+    auto address = lauf_runtime_add_heap_allocation(process, ptr, size);
+    memory_report.allocated(process, address, site, size);
+    vstack_ptr[0].as_address = address;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the address returned by one of the allocation builtins.
+LAUF_RUNTIME_BUILTIN(clauf_free, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_free",
+                     &clauf_malloc)
+{
+    auto address = vstack_ptr[0].as_address;
+    ++vstack_ptr;
+
+    if (!is_null(address))
+    {
+        // This also detects a double free.
+        lauf_runtime_allocation allocation;
+        if (address.offset != 0 || !lauf_runtime_get_allocation(process, address, &allocation)
+            || !lauf_runtime_leak_heap_allocation(process, address))
+            return lauf_runtime_panic(process, "invalid heap address");
+
+        memory_report.freed(process, address, allocation.size);
+        clauf::heap::deallocate(allocation.ptr, allocation.size);
+    }
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes count and size, and returns the address of the zeroed memory.
+LAUF_RUNTIME_BUILTIN(clauf_calloc, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_calloc",
+                     &clauf_free)
+{
+    auto site  = vstack_ptr[0].as_uint;
+    auto size  = vstack_ptr[1].as_uint;
+    auto count = vstack_ptr[2].as_uint;
+    vstack_ptr += 2;
+
+    std::uint64_t total;
+    if (__builtin_mul_overflow(count, size, &total))
+        return lauf_runtime_panic(process, "out of memory");
+
+    auto ptr = clauf::heap::allocate_zeroed(total, heap_alignment);
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "out of memory");
+
+    auto address = lauf_runtime_add_heap_allocation(process, ptr, total);
+    memory_report.allocated(process, address, site, total);
+    vstack_ptr[0].as_address = address;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the address and the new size, and returns the new address.
+// The old address is invalidated even if the memory could be resized in place.
+LAUF_RUNTIME_BUILTIN(clauf_realloc, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_realloc",
+                     &clauf_calloc)
+{
+    auto site    = vstack_ptr[0].as_uint;
+    auto size    = vstack_ptr[1].as_uint;
+    auto address = vstack_ptr[2].as_address;
+    vstack_ptr += 2;
+
+    if (is_null(address))
+    {
+        auto ptr = clauf::heap::allocate(size, heap_alignment);
+        if (ptr == nullptr)
+            return lauf_runtime_panic(process, "out of memory");
+
+        auto result = lauf_runtime_add_heap_allocation(process, ptr, size);
+        memory_report.allocated(process, result, site, size);
+        vstack_ptr[0].as_address = result;
+        LAUF_RUNTIME_BUILTIN_DISPATCH;
+    }
+
+    // This also detects a realloc() after free().
+    lauf_runtime_allocation allocation;
+    if (address.offset != 0 || !lauf_runtime_get_allocation(process, address, &allocation)
+        || !lauf_runtime_leak_heap_allocation(process, address))
+        return lauf_runtime_panic(process, "invalid heap address");
+    memory_report.freed(process, address, allocation.size);
+
+    void* ptr;
+    if (clauf::heap::can_resize_in_place(allocation.size, size))
+    {
+        ptr = allocation.ptr;
+    }
+    else
+    {
+        ptr = clauf::heap::allocate(size, heap_alignment);
+        if (ptr == nullptr)
+            return lauf_runtime_panic(process, "out of memory");
+        std::memcpy(ptr, allocation.ptr, std::min(std::size_t(size), allocation.size));
+        clauf::heap::deallocate(allocation.ptr, allocation.size);
+    }
+
+    auto result = lauf_runtime_add_heap_allocation(process, ptr, size);
+    memory_report.allocated(process, result, site, size);
+    vstack_ptr[0].as_address = result;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+// Objects created by the program, like arenas, are referred to by a handle, which is an index
+// into a table (plus one, so zero is never valid).
+template <typename T>
+struct handle_table
+{
+    // The table is only valid for a single process.
+    lauf_runtime_process*           process = nullptr;
+    std::vector<std::unique_ptr<T>> objects;
+
+    void sync(lauf_runtime_process* cur_process)
+    {
+        if (cur_process != process)
+        {
+            // The allocations of the previous process are gone, so we can free all objects.
+            process = cur_process;
+            objects.clear();
+        }
+    }
+
+    std::uint64_t create(lauf_runtime_process* cur_process)
+    {
+        sync(cur_process);
+        objects.push_back(std::make_unique<T>());
+        return objects.size();
+    }
+
+    T* get(lauf_runtime_process* cur_process, std::uint64_t handle)
+    {
+        sync(cur_process);
+        if (handle == 0 || handle > objects.size())
+            return nullptr;
+        return objects[handle - 1].get();
+    }
+
+    void destroy(std::uint64_t handle)
+    {
+        objects[handle - 1].reset();
+    }
+};
+
+// Memory allocated from an arena is added as a separate allocation, which is poisoned when the
+// arena is reset; this way, uses after reset are still detected.
+// After a reset, the arena hands out the same memory again, usually for objects of the same size.
+// Those re-use the poisoned allocation instead of adding a new one, so the allocations of the
+// process don't grow with every reset.
+struct arena_entry
+{
+    struct registration
+    {
+        std::size_t          size;
+        lauf_runtime_address address;
+    };
+
+    clauf::arena arena;
+    // Every allocation that has been added, indexed by its memory.
+    std::unordered_map<void*, registration> registrations;
+    // The allocations since the last reset.
+    std::vector<lauf_runtime_address> allocations;
+    std::size_t                       bytes = 0;
+
+    lauf_runtime_address add(lauf_runtime_process* process, void* ptr, std::size_t size)
+    {
+        lauf_runtime_address address;
+        // The memory has not been handed out since the last reset, so the allocation is poisoned.
+        if (auto iter = registrations.find(ptr);
+            iter != registrations.end() && iter->second.size == size)
+        {
+            address = iter->second.address;
+            lauf_runtime_unpoison_allocation(process, address);
+        }
+        else
+        {
+            address = lauf_runtime_add_static_mut_allocation(process, ptr, size);
+            registrations.insert_or_assign(ptr, registration{size, address});
+        }
+
+        allocations.push_back(address);
+        bytes += size;
+        return address;
+    }
+
+    void reset(lauf_runtime_process* process)
+    {
+        for (auto address : allocations)
+            lauf_runtime_poison_allocation(process, address);
+        memory_report.arenas.freed(bytes, allocations.size());
+        allocations.clear();
+        bytes = 0;
+        arena.reset();
+    }
+};
+
+handle_table<arena_entry> arena_table;
+
+LAUF_RUNTIME_BUILTIN(clauf_arena_create, 0, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_arena_create",
+                     &clauf_realloc)
+{
+    --vstack_ptr;
+    vstack_ptr[0].as_uint = arena_table.create(process);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes two arguments, the arena and the size, and returns the address of the memory.
+LAUF_RUNTIME_BUILTIN(clauf_arena_alloc, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_arena_alloc",
+                     &clauf_arena_create)
+{
+    auto size  = vstack_ptr[0].as_uint;
+    auto arena = arena_table.get(process, vstack_ptr[1].as_uint);
+    ++vstack_ptr;
+    if (arena == nullptr)
+        return lauf_runtime_panic(process, "invalid arena");
+
+    auto ptr = arena->arena.allocate(size);
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "out of memory");
+
+    auto address = arena->add(process, ptr, size);
+    memory_report.arenas.allocated(size);
+    vstack_ptr[0].as_address = address;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_arena_reset, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_arena_reset",
+                     &clauf_arena_alloc)
+{
+    auto arena = arena_table.get(process, vstack_ptr[0].as_uint);
+    ++vstack_ptr;
+    if (arena == nullptr)
+        return lauf_runtime_panic(process, "invalid arena");
+
+    arena->reset(process);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_arena_destroy, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_arena_destroy", &clauf_arena_reset)
+{
+    auto handle = vstack_ptr[0].as_uint;
+    auto arena  = arena_table.get(process, handle);
+    ++vstack_ptr;
+    if (arena == nullptr)
+        return lauf_runtime_panic(process, "invalid arena");
+
+    arena->reset(process);
+    arena_table.destroy(handle);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== format ===//
+// A call to printf() or sprintf() is lowered to a begin builtin, followed by one builtin for each
+// part of the format string, followed by an end builtin.
+// In between, the output is appended to the current target.
+struct format_state
+{
+    std::string* target = &output_buffer.buffer;
+    // The size of the target when the call started, and when the current conversion started.
+    std::size_t start = 0;
+    std::size_t mark  = 0;
+    // The buffer sprintf() writes into before copying it into lauf memory.
+    std::string sprintf_buffer;
+} format_state;
+
+// The field width and flags of a conversion are packed into a single integer.
+constexpr auto format_left_align = std::uint64_t(1) << 32;
+constexpr auto format_zero_pad   = std::uint64_t(1) << 33;
+
+template <typename T>
+void append_integer(std::string& target, T value, unsigned base, const char* digits)
+{
+    char buffer[32];
+    auto end = buffer + sizeof(buffer);
+    auto cur = end;
+    do
+    {
+        *--cur = digits[value % base];
+        value /= base;
+    } while (value != 0);
+    target.append(cur, end);
+}
+
+LAUF_RUNTIME_BUILTIN(clauf_printf_begin, 0, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_printf_begin",
+                     &clauf_arena_destroy)
+{
+    format_state.target = &output_buffer.buffer;
+    format_state.start  = format_state.target->size();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Returns the number of characters written.
+LAUF_RUNTIME_BUILTIN(clauf_printf_end, 0, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_printf_end",
+                     &clauf_printf_begin)
+{
+    --vstack_ptr;
+    vstack_ptr[0].as_uint = format_state.target->size() - format_state.start;
+    output_buffer.flush_if_full();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_sprintf_begin, 0, 0, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_sprintf_begin", &clauf_printf_end)
+{
+    format_state.sprintf_buffer.clear();
+    format_state.target = &format_state.sprintf_buffer;
+    format_state.start  = 0;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the address of the buffer and returns the number of characters written.
+LAUF_RUNTIME_BUILTIN(clauf_sprintf_end, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_sprintf_end",
+                     &clauf_sprintf_begin)
+{
+    auto& str = format_state.sprintf_buffer;
+    format_state.target = &output_buffer.buffer;
+
+    auto ptr = lauf_runtime_get_mut_ptr(process, vstack_ptr[0].as_address, {str.size() + 1, 1});
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "buffer overflow");
+    std::memcpy(ptr, str.c_str(), str.size() + 1);
+    vstack_ptr[0].as_uint = str.size();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+// Takes the address of the literal text and its length.
+LAUF_RUNTIME_BUILTIN(clauf_format_literal, 2, 0, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_format_literal", &clauf_sprintf_end)
+{
+    auto length = vstack_ptr[0].as_uint;
+    auto ptr    = lauf_runtime_get_const_ptr(process, vstack_ptr[1].as_address, {length, 1});
+    vstack_ptr += 2;
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    format_state.target->append(static_cast<const char*>(ptr), length);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Remembers where the next conversion starts, so it can be padded.
+LAUF_RUNTIME_BUILTIN(clauf_format_mark, 0, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_format_mark",
+                     &clauf_format_literal)
+{
+    format_state.mark = format_state.target->size();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Pads the conversion since the mark to the field width; takes the packed width and flags.
+LAUF_RUNTIME_BUILTIN(clauf_format_pad, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_format_pad",
+                     &clauf_format_mark)
+{
+    auto spec = vstack_ptr[0].as_uint;
+    ++vstack_ptr;
+
+    auto& target = *format_state.target;
+    auto  width  = std::size_t(spec & 0xFFFF'FFFF);
+    auto  length = target.size() - format_state.mark;
+    if (length < width)
+    {
+        auto count = width - length;
+        if ((spec & format_left_align) != 0)
+        {
+            target.append(count, ' ');
+        }
+        else if ((spec & format_zero_pad) != 0)
+        {
+            // Zeroes go after the sign.
+            auto pos = format_state.mark;
+            if (target[pos] == '-')
+                ++pos;
+            target.insert(pos, count, '0');
+        }
+        else
+        {
+            target.insert(format_state.mark, count, ' ');
+        }
+    }
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+LAUF_RUNTIME_BUILTIN(clauf_format_sint, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_format_sint",
+                     &clauf_format_pad)
+{
+    auto value = vstack_ptr[0].as_sint;
+    ++vstack_ptr;
+
+    if (value < 0)
+    {
+        format_state.target->push_back('-');
+        // Negate as unsigned, so that the minimal value doesn't overflow.
+        append_integer(*format_state.target, std::uint64_t(0) - std::uint64_t(value), 10,
+                       "0123456789");
+    }
+    else
+    {
+        append_integer(*format_state.target, std::uint64_t(value), 10, "0123456789");
+    }
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_format_uint, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_format_uint",
+                     &clauf_format_sint)
+{
+    append_integer(*format_state.target, vstack_ptr[0].as_uint, 10, "0123456789");
+    ++vstack_ptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_format_hex, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_format_hex",
+                     &clauf_format_uint)
+{
+    append_integer(*format_state.target, vstack_ptr[0].as_uint, 16, "0123456789abcdef");
+    ++vstack_ptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_format_hex_upper, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_format_hex_upper", &clauf_format_hex)
+{
+    append_integer(*format_state.target, vstack_ptr[0].as_uint, 16, "0123456789ABCDEF");
+    ++vstack_ptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_format_char, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_format_char",
+                     &clauf_format_hex_upper)
+{
+    format_state.target->push_back(char(vstack_ptr[0].as_uint));
+    ++vstack_ptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_format_string, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_format_string", &clauf_format_char)
+{
+    auto str = lauf_runtime_get_cstr(process, vstack_ptr[0].as_address);
+    ++vstack_ptr;
+    if (str == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    format_state.target->append(str);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+// Takes the address of the string and returns a non-negative value.
+LAUF_RUNTIME_BUILTIN(clauf_puts, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_puts",
+                     &clauf_format_string)
+{
+    auto str = lauf_runtime_get_cstr(process, vstack_ptr[0].as_address);
+    if (str == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    output_buffer.buffer.append(str);
+    output_buffer.buffer.push_back('\n');
+    output_buffer.flush_if_full();
+    vstack_ptr[0].as_uint = 0;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+// Flushes the output buffer before something else writes to stdout.
+LAUF_RUNTIME_BUILTIN(clauf_flush_output, 0, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_flush_output",
+                     &clauf_puts)
+{
+    output_buffer.flush();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== file mapping ===//
+// Files are mapped read-only and added as a single const allocation, so the program can access
+// them like any other memory.
+// The offset of a lauf address is 32 bit, so files of 4 GiB or more cannot be mapped.
+struct file_mappings
+{
+    struct mapping
+    {
+        void*       ptr;
+        std::size_t size;
+    };
+
+    // The mappings are only valid for a single process.
+    lauf_runtime_process*                      process = nullptr;
+    std::unordered_map<std::uint64_t, mapping> mappings;
+
+    file_mappings() = default;
+
+    file_mappings(const file_mappings&)            = delete;
+    file_mappings& operator=(const file_mappings&) = delete;
+
+    ~file_mappings()
+    {
+        unmap_all();
+    }
+
+    void sync(lauf_runtime_process* cur_process)
+    {
+        if (cur_process != process)
+        {
+            // The allocations of the previous process are gone, so nobody can access the files.
+            process = cur_process;
+            unmap_all();
+        }
+    }
+
+    void unmap_all()
+    {
+        for (auto& [key, mapping] : mappings)
+            if (mapping.size > 0)
+                munmap(mapping.ptr, mapping.size);
+        mappings.clear();
+    }
+} file_mappings;
+
+// Takes the path and the address where the length is stored; returns the address of the contents
+// or null if the file cannot be mapped, which includes files that are too big.
+LAUF_RUNTIME_BUILTIN(clauf_map_file, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_map_file",
+                     &clauf_flush_output)
+{
+    auto length_ptr = static_cast<std::uint64_t*>(lauf_runtime_get_mut_ptr(
+        process, vstack_ptr[0].as_address, {sizeof(std::uint64_t), alignof(std::uint64_t)}));
+    auto path = lauf_runtime_get_cstr(process, vstack_ptr[1].as_address);
+    ++vstack_ptr;
+    if (length_ptr == nullptr || path == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    file_mappings.sync(process);
+
+    void* ptr  = nullptr;
+    auto  size = std::size_t(0);
+    if (auto fd = open(path, O_RDONLY); fd >= 0)
+    {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)
+            && std::uint64_t(info.st_size) <= UINT32_MAX)
+        {
+            size = std::size_t(info.st_size);
+            if (size == 0)
+            {
+                // mmap() doesn't support empty mappings, but we still need an allocation.
+                static const char empty = 0;
+                ptr                     = const_cast<char*>(&empty);
+            }
+            else if (auto result = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                     result != MAP_FAILED)
+            {
+                ptr = result;
+            }
+        }
+        close(fd);
+    }
+
+    if (ptr == nullptr)
+    {
+        *length_ptr              = 0;
+        vstack_ptr[0].as_address = lauf_runtime_address_null;
+    }
+    else
+    {
+        auto address = lauf_runtime_add_static_const_allocation(process, ptr, size);
+
+        lauf_runtime_value key;
+        key.as_address = address;
+        file_mappings.mappings[key.as_uint] = {ptr, size};
+        memory_report.file_mappings.allocated(size);
+
+        *length_ptr              = size;
+        vstack_ptr[0].as_address = address;
+    }
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the address returned by clauf_map_file.
+LAUF_RUNTIME_BUILTIN(clauf_unmap_file, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_unmap_file",
+                     &clauf_map_file)
+{
+    auto key = vstack_ptr[0].as_uint;
+    ++vstack_ptr;
+
+    file_mappings.sync(process);
+    auto iter = file_mappings.mappings.find(key);
+    if (iter == file_mappings.mappings.end())
+        return lauf_runtime_panic(process, "invalid file mapping");
+
+    // Any further access through the address is an error.
+    lauf_runtime_value address;
+    address.as_uint = key;
+    lauf_runtime_poison_allocation(process, address.as_address);
+
+    if (iter->second.size > 0)
+        munmap(iter->second.ptr, iter->second.size);
+    memory_report.file_mappings.freed(iter->second.size);
+    file_mappings.mappings.erase(iter);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== containers ===//
+// Hash maps and vectors of integers that live in native memory.
+// Every operation is a single builtin, so lookup and growth run natively instead of as bytecode.
+// Their memory comes from the pool, just like the heap of the program.
+handle_table<clauf::hash_map>   map_table;
+handle_table<clauf::int_vector> vector_table;
+
+LAUF_RUNTIME_BUILTIN(clauf_map_create, 0, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_map_create",
+                     &clauf_unmap_file)
+{
+    --vstack_ptr;
+    vstack_ptr[0].as_uint = map_table.create(process);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_map_destroy, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_map_destroy",
+                     &clauf_map_create)
+{
+    auto handle = vstack_ptr[0].as_uint;
+    ++vstack_ptr;
+    if (map_table.get(process, handle) == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+
+    map_table.destroy(handle);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_map_size, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_map_size",
+                     &clauf_map_destroy)
+{
+    auto map = map_table.get(process, vstack_ptr[0].as_uint);
+    if (map == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+
+    vstack_ptr[0].as_uint = map->size();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the map, the key and the value; returns whether the key was newly inserted.
+LAUF_RUNTIME_BUILTIN(clauf_map_insert, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_map_insert",
+                     &clauf_map_size)
+{
+    auto value = vstack_ptr[0].as_uint;
+    auto key   = vstack_ptr[1].as_uint;
+    auto map   = map_table.get(process, vstack_ptr[2].as_uint);
+    vstack_ptr += 2;
+    if (map == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+
+    try
+    {
+        vstack_ptr[0].as_sint = map->insert(key, value);
+    }
+    catch (std::bad_alloc&)
+    {
+        return lauf_runtime_panic(process, "out of memory");
+    }
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the map, the key and the address where the value is stored (which may be null); returns
+// whether the key was found.
+LAUF_RUNTIME_BUILTIN(clauf_map_find, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_map_find",
+                     &clauf_map_insert)
+{
+    auto value_address = vstack_ptr[0].as_address;
+    auto key           = vstack_ptr[1].as_uint;
+    auto map           = map_table.get(process, vstack_ptr[2].as_uint);
+    vstack_ptr += 2;
+    if (map == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+
+    auto value = map->find(key);
+    if (value != nullptr && !is_null(value_address))
+    {
+        auto ptr = lauf_runtime_get_mut_ptr(process, value_address,
+                                            {sizeof(std::uint64_t), alignof(std::uint64_t)});
+        if (ptr == nullptr)
+            return lauf_runtime_panic(process, "invalid address");
+        std::memcpy(ptr, value, sizeof(std::uint64_t));
+    }
+    vstack_ptr[0].as_sint = value != nullptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the map and the key; returns whether the key was removed.
+LAUF_RUNTIME_BUILTIN(clauf_map_erase, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_map_erase",
+                     &clauf_map_find)
+{
+    auto key = vstack_ptr[0].as_uint;
+    auto map = map_table.get(process, vstack_ptr[1].as_uint);
+    ++vstack_ptr;
+    if (map == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+
+    vstack_ptr[0].as_sint = map->erase(key);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// The byte string variants take the address and length of the key instead of an integer.
+// The key is copied into the map on insertion.
+LAUF_RUNTIME_BUILTIN(clauf_map_insert_bytes, 4, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_map_insert_bytes", &clauf_map_erase)
+{
+    auto value  = vstack_ptr[0].as_uint;
+    auto length = vstack_ptr[1].as_uint;
+    auto key    = lauf_runtime_get_const_ptr(process, vstack_ptr[2].as_address, {length, 1});
+    auto map    = map_table.get(process, vstack_ptr[3].as_uint);
+    vstack_ptr += 3;
+    if (map == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+    if (key == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    try
+    {
+        vstack_ptr[0].as_sint = map->insert(static_cast<const char*>(key), length, value);
+    }
+    catch (std::bad_alloc&)
+    {
+        return lauf_runtime_panic(process, "out of memory");
+    }
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_map_find_bytes, 4, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_map_find_bytes", &clauf_map_insert_bytes)
+{
+    auto value_address = vstack_ptr[0].as_address;
+    auto length        = vstack_ptr[1].as_uint;
+    auto key = lauf_runtime_get_const_ptr(process, vstack_ptr[2].as_address, {length, 1});
+    auto map = map_table.get(process, vstack_ptr[3].as_uint);
+    vstack_ptr += 3;
+    if (map == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+    if (key == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    auto value = map->find(static_cast<const char*>(key), length);
+    if (value != nullptr && !is_null(value_address))
+    {
+        auto ptr = lauf_runtime_get_mut_ptr(process, value_address,
+                                            {sizeof(std::uint64_t), alignof(std::uint64_t)});
+        if (ptr == nullptr)
+            return lauf_runtime_panic(process, "invalid address");
+        std::memcpy(ptr, value, sizeof(std::uint64_t));
+    }
+    vstack_ptr[0].as_sint = value != nullptr;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_map_erase_bytes, 3, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_map_erase_bytes", &clauf_map_find_bytes)
+{
+    auto length = vstack_ptr[0].as_uint;
+    auto key    = lauf_runtime_get_const_ptr(process, vstack_ptr[1].as_address, {length, 1});
+    auto map    = map_table.get(process, vstack_ptr[2].as_uint);
+    vstack_ptr += 2;
+    if (map == nullptr)
+        return lauf_runtime_panic(process, "invalid map");
+    if (key == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    vstack_ptr[0].as_sint = map->erase(static_cast<const char*>(key), length);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+LAUF_RUNTIME_BUILTIN(clauf_vector_create, 0, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_vector_create", &clauf_map_erase_bytes)
+{
+    --vstack_ptr;
+    vstack_ptr[0].as_uint = vector_table.create(process);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_vector_destroy, 1, 0, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_vector_destroy", &clauf_vector_create)
+{
+    auto handle = vstack_ptr[0].as_uint;
+    ++vstack_ptr;
+    if (vector_table.get(process, handle) == nullptr)
+        return lauf_runtime_panic(process, "invalid vector");
+
+    vector_table.destroy(handle);
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_vector_size, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_vector_size",
+                     &clauf_vector_destroy)
+{
+    auto vector = vector_table.get(process, vstack_ptr[0].as_uint);
+    if (vector == nullptr)
+        return lauf_runtime_panic(process, "invalid vector");
+
+    vstack_ptr[0].as_uint = vector->size();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the vector and the value.
+LAUF_RUNTIME_BUILTIN(clauf_vector_push, 2, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_vector_push",
+                     &clauf_vector_size)
+{
+    auto value  = vstack_ptr[0].as_uint;
+    auto vector = vector_table.get(process, vstack_ptr[1].as_uint);
+    vstack_ptr += 2;
+    if (vector == nullptr)
+        return lauf_runtime_panic(process, "invalid vector");
+
+    try
+    {
+        vector->push_back(value);
+    }
+    catch (std::bad_alloc&)
+    {
+        return lauf_runtime_panic(process, "out of memory");
+    }
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Removes and returns the last value.
+LAUF_RUNTIME_BUILTIN(clauf_vector_pop, 1, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_vector_pop",
+                     &clauf_vector_push)
+{
+    auto vector = vector_table.get(process, vstack_ptr[0].as_uint);
+    if (vector == nullptr)
+        return lauf_runtime_panic(process, "invalid vector");
+    if (vector->empty())
+        return lauf_runtime_panic(process, "vector is empty");
+
+    vstack_ptr[0].as_uint = vector->back();
+    vector->pop_back();
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the vector and the index.
+LAUF_RUNTIME_BUILTIN(clauf_vector_get, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_vector_get",
+                     &clauf_vector_pop)
+{
+    auto index  = vstack_ptr[0].as_uint;
+    auto vector = vector_table.get(process, vstack_ptr[1].as_uint);
+    ++vstack_ptr;
+    if (vector == nullptr)
+        return lauf_runtime_panic(process, "invalid vector");
+    if (index >= vector->size())
+        return lauf_runtime_panic(process, "vector index out of bounds");
+
+    vstack_ptr[0].as_uint = (*vector)[index];
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the vector, the index and the value.
+LAUF_RUNTIME_BUILTIN(clauf_vector_set, 3, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_vector_set",
+                     &clauf_vector_get)
+{
+    auto value  = vstack_ptr[0].as_uint;
+    auto index  = vstack_ptr[1].as_uint;
+    auto vector = vector_table.get(process, vstack_ptr[2].as_uint);
+    vstack_ptr += 3;
+    if (vector == nullptr)
+        return lauf_runtime_panic(process, "invalid vector");
+    if (index >= vector->size())
+        return lauf_runtime_panic(process, "vector index out of bounds");
+
+    (*vector)[index] = value;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== sort ===//
+// Takes the address of the array, the number and size of elements, the offset and size of the
+// integer key in each element, and whether the key is signed.
+LAUF_RUNTIME_BUILTIN(clauf_sort, 6, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_sort",
+                     &clauf_vector_set)
+{
+    auto is_signed  = vstack_ptr[0].as_sint != 0;
+    auto key_size   = vstack_ptr[1].as_uint;
+    auto key_offset = vstack_ptr[2].as_uint;
+    auto elem_size  = vstack_ptr[3].as_uint;
+    auto count      = vstack_ptr[4].as_uint;
+    auto address    = vstack_ptr[5].as_address;
+    vstack_ptr += 6;
+
+    if (key_size == 0 || key_size > 8 || key_offset > elem_size
+        || key_size > elem_size - key_offset)
+        return lauf_runtime_panic(process, "invalid sort key");
+
+    std::uint64_t total;
+    if (__builtin_mul_overflow(count, elem_size, &total))
+        return lauf_runtime_panic(process, "invalid address");
+
+    // We validate the entire array once, then sort natively.
+    auto ptr = lauf_runtime_get_mut_ptr(process, address, {total, 1});
+    if (ptr == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    clauf::sort(ptr, count, elem_size, {key_offset, key_size, is_signed});
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== asynchronous I/O ===//
+// Reads and writes are queued and executed as a batch when the program waits for them.
+// The buffers are only resolved then, so they are still valid while the kernel accesses them.
+struct io_queue
+{
+    struct entry
+    {
+        int                  fd;
+        bool                 is_write;
+        lauf_runtime_address buffer;
+        std::size_t          length;
+        std::uint64_t        offset;
+    };
+
+    // The queue is only valid for a single process.
+    lauf_runtime_process*          process = nullptr;
+    std::vector<entry>             pending;
+    std::vector<clauf::io_request> requests;
+
+    void sync(lauf_runtime_process* cur_process)
+    {
+        if (cur_process != process)
+        {
+            process = cur_process;
+            pending.clear();
+        }
+    }
+} io_queue;
+
+// Takes the file descriptor, the buffer, its length, and the offset in the file; returns the
+// index of the result in the array passed to clauf_io_wait.
+LAUF_RUNTIME_BUILTIN(clauf_io_submit_read, 4, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_io_submit_read", &clauf_sort)
+{
+    auto offset = vstack_ptr[0].as_uint;
+    auto length = vstack_ptr[1].as_uint;
+    auto buffer = vstack_ptr[2].as_address;
+    auto fd     = int(vstack_ptr[3].as_sint);
+    vstack_ptr += 3;
+
+    // We check the buffer now to report errors early; it is checked again when executing.
+    if (lauf_runtime_get_mut_ptr(process, buffer, {length, 1}) == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    io_queue.sync(process);
+    io_queue.pending.push_back({fd, false, buffer, length, offset});
+    vstack_ptr[0].as_uint = io_queue.pending.size() - 1;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_io_submit_write, 4, 1, LAUF_RUNTIME_BUILTIN_DEFAULT,
+                     "clauf_io_submit_write", &clauf_io_submit_read)
+{
+    auto offset = vstack_ptr[0].as_uint;
+    auto length = vstack_ptr[1].as_uint;
+    auto buffer = vstack_ptr[2].as_address;
+    auto fd     = int(vstack_ptr[3].as_sint);
+    vstack_ptr += 3;
+
+    if (lauf_runtime_get_const_ptr(process, buffer, {length, 1}) == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    io_queue.sync(process);
+    io_queue.pending.push_back({fd, true, buffer, length, offset});
+    vstack_ptr[0].as_uint = io_queue.pending.size() - 1;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+// Takes the address of the result array and its capacity; executes all pending requests and
+// returns their number.
+// The result of each request is the number of bytes transferred or a negative error code.
+LAUF_RUNTIME_BUILTIN(clauf_io_wait, 2, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_io_wait",
+                     &clauf_io_submit_write)
+{
+    auto capacity = vstack_ptr[0].as_uint;
+    auto address  = vstack_ptr[1].as_address;
+    ++vstack_ptr;
+
+    io_queue.sync(process);
+    auto count = io_queue.pending.size();
+    if (count > capacity)
+        return lauf_runtime_panic(process, "too many pending I/O requests");
+
+    auto results = static_cast<std::int64_t*>(lauf_runtime_get_mut_ptr(
+        process, address, {count * sizeof(std::int64_t), alignof(std::int64_t)}));
+    if (results == nullptr)
+        return lauf_runtime_panic(process, "invalid address");
+
+    auto& requests = io_queue.requests;
+    requests.clear();
+    for (auto& entry : io_queue.pending)
+    {
+        auto buffer = entry.is_write
+                          ? const_cast<void*>(lauf_runtime_get_const_ptr(process, entry.buffer,
+                                                                         {entry.length, 1}))
+                          : lauf_runtime_get_mut_ptr(process, entry.buffer, {entry.length, 1});
+        if (buffer == nullptr)
+        {
+            io_queue.pending.clear();
+            return lauf_runtime_panic(process, "invalid address");
+        }
+
+        requests.push_back({entry.fd, entry.is_write, buffer, entry.length, entry.offset});
+    }
+    io_queue.pending.clear();
+
+    // Writes to stdout need to come after the buffered output.
+    output_buffer.flush();
+    clauf::execute_io(requests);
+
+    for (auto i = std::size_t(0); i != count; ++i)
+        results[i] = requests[i].result;
+    vstack_ptr[0].as_uint = count;
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+
+//=== benchmark ===//
+std::uint64_t now_ns()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+// The results of all benchmarks, which are printed to stderr when the interpreter exits.
+struct bench_results
+{
+    struct result
+    {
+        std::string   name;
+        std::size_t   samples;
+        std::uint64_t iterations;
+        double        median_ns;
+        double        mad_ns;
+        double        min_ns;
+    };
+
+    std::vector<result> results;
+
+    ~bench_results()
+    {
+        if (results.empty())
+            return;
+
+        std::fprintf(stderr, "benchmark\tsamples\titerations\tmedian_ns\tmad_ns\tmin_ns\n");
+        for (auto& r : results)
+            std::fprintf(stderr, "%s\t%zu\t%llu\t%.1f\t%.1f\t%.1f\n", r.name.c_str(), r.samples,
+                         static_cast<unsigned long long>(r.iterations), r.median_ns, r.mad_ns,
+                         r.min_ns);
+    }
+} bench_results;
+
+// Iterations are batched into samples of at least that duration, so timer overhead doesn't matter.
+constexpr auto bench_sample_ns = std::uint64_t(1'000'000);
+constexpr auto bench_warmup_ns = std::uint64_t(10'000'000);
+constexpr auto bench_samples   = std::size_t(31);
+
+double median_of(std::vector<double>& values)
+{
+    std::sort(values.begin(), values.end());
+    auto mid = values.size() / 2;
+    return values.size() % 2 == 1 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+// Takes the name, the function, which takes a void* context, and the context.
+// The function is called until the warmup time has passed, then the remaining calls are timed in
+// samples; the median and median absolute deviation of the time per call are recorded.
+LAUF_RUNTIME_BUILTIN(clauf_bench, 3, 0, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_bench",
+                     &clauf_io_wait)
+{
+    auto context  = vstack_ptr[0];
+    auto function = vstack_ptr[1].as_function_address;
+    auto name     = lauf_runtime_get_cstr(process, vstack_ptr[2].as_address);
+    vstack_ptr += 3;
+    if (name == nullptr)
+        return lauf_runtime_panic(process, "invalid string");
+
+    auto fn = lauf_runtime_get_function_ptr(process, function, {1, 0});
+    if (fn == nullptr)
+        return lauf_runtime_panic(process, "invalid function address");
+
+    // If the function panics, the panic has already been reported.
+    auto run = [&](std::uint64_t iterations) {
+        for (auto i = std::uint64_t(0); i != iterations; ++i)
+            if (!lauf_runtime_call(process, fn, &context, nullptr))
+                return false;
+        return true;
+    };
+
+    // Warmup and estimate the number of iterations per sample.
+    auto warmup_iterations = std::uint64_t(0);
+    auto warmup_start      = now_ns();
+    auto warmup_time       = std::uint64_t(0);
+    while (warmup_iterations < 3 || warmup_time < bench_warmup_ns)
+    {
+        if (!run(1))
+            return false;
+        ++warmup_iterations;
+        warmup_time = now_ns() - warmup_start;
+    }
+    auto iterations_per_sample = std::max(std::uint64_t(1),
+                                          bench_sample_ns * warmup_iterations / warmup_time);
+
+    std::vector<double> samples;
+    for (auto i = std::size_t(0); i != bench_samples; ++i)
+    {
+        auto start = now_ns();
+        if (!run(iterations_per_sample))
+            return false;
+        samples.push_back(double(now_ns() - start) / double(iterations_per_sample));
+    }
+
+    auto min    = *std::min_element(samples.begin(), samples.end());
+    auto median = median_of(samples);
+
+    std::vector<double> deviations;
+    for (auto sample : samples)
+        deviations.push_back(sample < median ? median - sample : sample - median);
+    auto mad = median_of(deviations);
+
+    bench_results.results.push_back({name, samples.size(),
+                                     iterations_per_sample * samples.size(), median, mad, min});
+
+    LAUF_RUNTIME_BUILTIN_DISPATCH;
+}
+LAUF_RUNTIME_BUILTIN(clauf_now_ns, 0, 1, LAUF_RUNTIME_BUILTIN_DEFAULT, "clauf_now_ns",
+                     &clauf_bench)
+{
+    --vstack_ptr;
+    vstack_ptr[0].as_uint = now_ns();
 
     LAUF_RUNTIME_BUILTIN_DISPATCH;
 }
@@ -347,6 +2371,8 @@ struct context
     clauf::diagnostic_logger*                                              logger;
     const clauf::ast_symbol_interner*                                      symbols;
     const clauf::file*                                                     input;
+    // The path the debug locations of the module refer to.
+    const char*                                                            debug_path;
     lauf_asm_module*                                                       mod;
     lauf_asm_chunk*                                                        consteval_chunk;
     lauf_asm_global*                                                       consteval_result_global;
@@ -358,6 +2384,22 @@ struct context
     dryad::node_map<const clauf::decl, lauf_asm_local*> local_vars;
 };
 
+// Returns the index of the source location of a heap allocation in memory_report.sites.
+std::uint64_t codegen_allocation_site(const context& ctx, const clauf::expr* expr)
+{
+    // Computing the location is not free, so we only do it when somebody looks at them.
+    if (!memory_report.enabled)
+        return 0;
+
+    auto position = ctx.input->position_of(ctx.input->location_of(expr).begin);
+
+    auto site = position.file->path;
+    site += ':' + std::to_string(position.line_nr);
+    site += ':' + std::to_string(position.column_nr);
+    memory_report.sites.push_back(std::move(site));
+    return memory_report.sites.size() - 1;
+}
+
 enum class codegen_expr_mode
 {
     // Evaluates the expression and result in the address; only applicable for actual lvalues or
@@ -492,6 +2534,85 @@ void codegen_member_as_lvalue(context& ctx, lauf_asm_builder* b,
     lauf_asm_inst_aggregate_member(b, members.size() - 1, members.data(), members.size());
 }
 
+// Generates a call to printf() or sprintf(), pushing the number of characters written.
+// The format string has already been verified, so we can just parse it again.
+void codegen_format(context& ctx, lauf_asm_builder* b, const clauf::builtin_expr* expr)
+{
+    std::vector<const clauf::expr*> arguments;
+    for (auto argument : expr->arguments())
+        arguments.push_back(argument);
+
+    // For sprintf(), the first argument is the buffer, which is consumed by the end builtin.
+    auto is_sprintf   = expr->builtin() == clauf::builtin_expr::sprintf;
+    auto format_index = is_sprintf ? 1u : 0u;
+    if (is_sprintf)
+        codegen_expr(ctx, b, arguments[0], codegen_expr_mode::value);
+
+    // Evaluate all arguments before starting, as they might print themselves.
+    for (auto idx = format_index + 1; idx < arguments.size(); ++idx)
+        codegen_expr(ctx, b, arguments[idx], codegen_expr_mode::value);
+    auto remaining_arguments = std::uint16_t(arguments.size() - format_index - 1);
+
+    auto literal = dryad::node_cast<clauf::string_literal_expr>(
+        dryad::node_cast<clauf::decay_expr>(arguments[format_index])->child());
+    auto directives = clauf::parse_format_string(literal->value());
+
+    lauf_asm_inst_call_builtin(b, is_sprintf ? clauf_sprintf_begin : clauf_printf_begin);
+    for (auto& directive : *directives)
+    {
+        if (directive.kind == clauf::format_directive::literal)
+        {
+            auto str = lauf_asm_build_string_literal(b, directive.text.c_str());
+            lauf_asm_inst_global_addr(b, str);
+            lauf_asm_inst_uint(b, directive.text.size());
+            lauf_asm_inst_call_builtin(b, clauf_format_literal);
+            continue;
+        }
+
+        // The argument of the conversion is the bottom-most remaining one.
+        --remaining_arguments;
+        if (remaining_arguments > 0)
+            lauf_asm_inst_roll(b, remaining_arguments);
+
+        if (directive.width > 0)
+            lauf_asm_inst_call_builtin(b, clauf_format_mark);
+        switch (directive.kind)
+        {
+        case clauf::format_directive::literal:
+            break;
+        case clauf::format_directive::sint:
+            lauf_asm_inst_call_builtin(b, clauf_format_sint);
+            break;
+        case clauf::format_directive::uint:
+            lauf_asm_inst_call_builtin(b, clauf_format_uint);
+            break;
+        case clauf::format_directive::hex:
+            lauf_asm_inst_call_builtin(b, clauf_format_hex);
+            break;
+        case clauf::format_directive::hex_upper:
+            lauf_asm_inst_call_builtin(b, clauf_format_hex_upper);
+            break;
+        case clauf::format_directive::char_:
+            lauf_asm_inst_call_builtin(b, clauf_format_char);
+            break;
+        case clauf::format_directive::string:
+            lauf_asm_inst_call_builtin(b, clauf_format_string);
+            break;
+        }
+        if (directive.width > 0)
+        {
+            auto spec = std::uint64_t(directive.width);
+            if (directive.left_align)
+                spec |= format_left_align;
+            if (directive.zero_pad)
+                spec |= format_zero_pad;
+            lauf_asm_inst_uint(b, spec);
+            lauf_asm_inst_call_builtin(b, clauf_format_pad);
+        }
+    }
+    lauf_asm_inst_call_builtin(b, is_sprintf ? clauf_sprintf_end : clauf_printf_end);
+}
+
 void codegen_expr(context& ctx, lauf_asm_builder* b, const clauf::expr* expr,
                   codegen_expr_mode mode)
 {
@@ -544,13 +2665,23 @@ void codegen_expr(context& ctx, lauf_asm_builder* b, const clauf::expr* expr,
         [&](const clauf::string_literal_expr* expr) { codegen_constant(ctx, b, expr, mode); },
         [&](const clauf::type_constant_expr* expr) { codegen_constant(ctx, b, expr, mode); },
         [&](const clauf::builtin_expr* expr) {
-            // Get the value of the argument.
-            codegen_expr(ctx, b, expr->expr(), codegen_expr_mode::value);
+            if (expr->builtin() == clauf::builtin_expr::printf
+                || expr->builtin() == clauf::builtin_expr::sprintf)
+            {
+                codegen_format(ctx, b, expr);
+                process_mode(false);
+                return;
+            }
+
+            // Get the value of the arguments.
+            for (auto argument : expr->arguments())
+                codegen_expr(ctx, b, argument, codegen_expr_mode::value);
 
             switch (expr->builtin())
             {
             case clauf::builtin_expr::print:
-                // Print the value on top of the stack.
+                // Print the value on top of the stack, after the buffered output.
+                lauf_asm_inst_call_builtin(b, clauf_flush_output);
                 lauf_asm_inst_call_builtin(b, lauf_lib_debug_print);
                 // Remove the value after we have printed it.
                 lauf_asm_inst_pop(b, 0);
@@ -561,16 +2692,119 @@ void codegen_expr(context& ctx, lauf_asm_builder* b, const clauf::expr* expr,
                 break;
 
             case clauf::builtin_expr::malloc:
-                // Add the alignment parameter.
-                lauf_asm_inst_uint(b, 8);
-                // Move size argument which is below alignment to the top.
-                lauf_asm_inst_roll(b, 1);
-                // Allocate memory.
-                lauf_asm_inst_call_builtin(b, lauf_lib_heap_alloc);
+                lauf_asm_inst_uint(b, codegen_allocation_site(ctx, expr));
+                lauf_asm_inst_call_builtin(b, clauf_malloc);
                 break;
             case clauf::builtin_expr::free:
                 // Call free with the address on top of the stack.
-                lauf_asm_inst_call_builtin(b, lauf_lib_heap_free);
+                lauf_asm_inst_call_builtin(b, clauf_free);
+                break;
+            case clauf::builtin_expr::realloc:
+                lauf_asm_inst_uint(b, codegen_allocation_site(ctx, expr));
+                lauf_asm_inst_call_builtin(b, clauf_realloc);
+                break;
+            case clauf::builtin_expr::calloc:
+                lauf_asm_inst_uint(b, codegen_allocation_site(ctx, expr));
+                lauf_asm_inst_call_builtin(b, clauf_calloc);
+                break;
+
+            case clauf::builtin_expr::arena_create:
+                lauf_asm_inst_call_builtin(b, clauf_arena_create);
+                break;
+            case clauf::builtin_expr::arena_alloc:
+                lauf_asm_inst_call_builtin(b, clauf_arena_alloc);
+                break;
+            case clauf::builtin_expr::arena_reset:
+                lauf_asm_inst_call_builtin(b, clauf_arena_reset);
+                break;
+            case clauf::builtin_expr::arena_destroy:
+                lauf_asm_inst_call_builtin(b, clauf_arena_destroy);
+                break;
+
+            case clauf::builtin_expr::printf:
+            case clauf::builtin_expr::sprintf:
+                CLAUF_UNREACHABLE("handled above");
+                break;
+            case clauf::builtin_expr::puts:
+                lauf_asm_inst_call_builtin(b, clauf_puts);
+                break;
+
+            case clauf::builtin_expr::map_file:
+                lauf_asm_inst_call_builtin(b, clauf_map_file);
+                break;
+            case clauf::builtin_expr::unmap_file:
+                lauf_asm_inst_call_builtin(b, clauf_unmap_file);
+                break;
+
+            case clauf::builtin_expr::map_create:
+                lauf_asm_inst_call_builtin(b, clauf_map_create);
+                break;
+            case clauf::builtin_expr::map_destroy:
+                lauf_asm_inst_call_builtin(b, clauf_map_destroy);
+                break;
+            case clauf::builtin_expr::map_size:
+                lauf_asm_inst_call_builtin(b, clauf_map_size);
+                break;
+            case clauf::builtin_expr::map_insert:
+                lauf_asm_inst_call_builtin(b, clauf_map_insert);
+                break;
+            case clauf::builtin_expr::map_find:
+                lauf_asm_inst_call_builtin(b, clauf_map_find);
+                break;
+            case clauf::builtin_expr::map_erase:
+                lauf_asm_inst_call_builtin(b, clauf_map_erase);
+                break;
+            case clauf::builtin_expr::map_insert_bytes:
+                lauf_asm_inst_call_builtin(b, clauf_map_insert_bytes);
+                break;
+            case clauf::builtin_expr::map_find_bytes:
+                lauf_asm_inst_call_builtin(b, clauf_map_find_bytes);
+                break;
+            case clauf::builtin_expr::map_erase_bytes:
+                lauf_asm_inst_call_builtin(b, clauf_map_erase_bytes);
+                break;
+
+            case clauf::builtin_expr::vector_create:
+                lauf_asm_inst_call_builtin(b, clauf_vector_create);
+                break;
+            case clauf::builtin_expr::vector_destroy:
+                lauf_asm_inst_call_builtin(b, clauf_vector_destroy);
+                break;
+            case clauf::builtin_expr::vector_size:
+                lauf_asm_inst_call_builtin(b, clauf_vector_size);
+                break;
+            case clauf::builtin_expr::vector_push:
+                lauf_asm_inst_call_builtin(b, clauf_vector_push);
+                break;
+            case clauf::builtin_expr::vector_pop:
+                lauf_asm_inst_call_builtin(b, clauf_vector_pop);
+                break;
+            case clauf::builtin_expr::vector_get:
+                lauf_asm_inst_call_builtin(b, clauf_vector_get);
+                break;
+            case clauf::builtin_expr::vector_set:
+                lauf_asm_inst_call_builtin(b, clauf_vector_set);
+                break;
+
+            case clauf::builtin_expr::sort:
+                lauf_asm_inst_call_builtin(b, clauf_sort);
+                break;
+
+            case clauf::builtin_expr::io_submit_read:
+                lauf_asm_inst_call_builtin(b, clauf_io_submit_read);
+                break;
+            case clauf::builtin_expr::io_submit_write:
+                lauf_asm_inst_call_builtin(b, clauf_io_submit_write);
+                break;
+            case clauf::builtin_expr::io_wait:
+                lauf_asm_inst_call_builtin(b, clauf_io_wait);
+                break;
+
+            case clauf::builtin_expr::bench:
+                lauf_asm_inst_call_builtin(b, clauf_bench);
+                break;
+            case clauf::builtin_expr::now_ns:
+                lauf_asm_inst_call_builtin(b, clauf_now_ns);
                 break;
             }
 
@@ -739,6 +2973,11 @@ void codegen_expr(context& ctx, lauf_asm_builder* b, const clauf::expr* expr,
             {
                 // We don't need to do anything, pointers in lauf aren't typed.
             }
+            else if (clauf::is_pointer(expr->type())
+                     && dryad::node_has_kind<clauf::function_type>(expr->child()->type()))
+            {
+                // The value of a function is already its address.
+            }
             else if (clauf::is_pointer(expr->type()) && clauf::is_nullptr_constant(expr->child()))
             {
                 // We don't want the value of the child expression.
@@ -1423,17 +3662,16 @@ lauf_asm_function* codegen_function_body(context& ctx, const clauf::function_dec
     dryad::visit_tree(
         decl->body(),
         //=== statements ===//
-        [&, anchor = lexy::input_location_anchor(ctx.input->buffer())] //
-        (dryad::traverse_event_enter, const clauf::stmt* stmt) mutable {
+        [&](dryad::traverse_event_enter, const clauf::stmt* stmt) {
             // Generate debug location for all instructions generated by a statement.
-            auto location = ctx.input->location_of(stmt);
-            auto expanded_location
-                = lexy::get_input_location(ctx.input->buffer(), location.begin, anchor);
-
-            lauf_asm_build_debug_location(b, {std::uint16_t(expanded_location.line_nr()),
-                                              std::uint16_t(expanded_location.column_nr()), false});
-
-            anchor = expanded_location.anchor();
+            // The locations are relative to the path of the module, so statements from other
+            // files get a synthetic location instead of a wrong one.
+            auto position = ctx.input->position_of(ctx.input->location_of(stmt).begin);
+            if (position.file->path == ctx.debug_path)
+                lauf_asm_build_debug_location(b, {std::uint16_t(position.line_nr),
+                                                  std::uint16_t(position.column_nr), false});
+            else
+                lauf_asm_build_debug_location(b, {0, 0, true});
         },
         [&](dryad::child_visitor<clauf::node_kind>, const clauf::expr_stmt* stmt) {
             // Evaluate and discard the expression.
@@ -1579,24 +3817,190 @@ lauf_asm_function* codegen_function_body(context& ctx, const clauf::function_dec
 }
 
 clauf::ffi_function* get_ffi_function(context& ctx, clauf::code& code,
-                                      const clauf::function_decl* decl)
+                                      const clauf::native_libraries& libraries,
+                                      const clauf::function_decl*    decl)
 {
     std::vector<ffi_type*> types;
     for (auto param : decl->parameters())
-        types.push_back(codegen_ffi_type(param->type()));
+        types.push_back(codegen_ffi_type(code, param->type()));
+
+    // The address and cif are only resolved once the function is actually called.
+    return code.add_ffi_function({decl->name().c_str(*ctx.symbols), &libraries, std::move(types),
+                                  codegen_ffi_type(code, decl->type()->return_type())});
+}
+
+// Returns the builtin that calls the native function directly, or nullptr if libffi is needed.
+const lauf_runtime_builtin* get_direct_native_builtin(const clauf::ffi_function& fn)
+{
+    auto arity = fn.argument_types.size();
+    if (arity > max_direct_native_arguments)
+        return nullptr;
+
+    auto is_word = [](const ffi_type* ty) {
+        return ty == &ffi_type_sint64 || ty == &ffi_type_uint64 || ty == &ffi_type_pointer;
+    };
+    auto is_integer_or_pointer = [&](const ffi_type* ty) {
+        return is_word(ty) || ty == &ffi_type_sint8 || ty == &ffi_type_uint8
+               || ty == &ffi_type_sint16 || ty == &ffi_type_uint16 || ty == &ffi_type_sint32
+               || ty == &ffi_type_uint32;
+    };
+    for (auto ty : fn.argument_types)
+        if (!is_integer_or_pointer(ty))
+            return nullptr;
+
+    auto return_kind = [&] {
+        auto ty = fn.return_type;
+        if (ty == &ffi_type_void)
+            return native_return_kind::void_;
+        else if (ty == &ffi_type_sint8)
+            return native_return_kind::sint8;
+        else if (ty == &ffi_type_uint8)
+            return native_return_kind::uint8;
+        else if (ty == &ffi_type_sint16)
+            return native_return_kind::sint16;
+        else if (ty == &ffi_type_uint16)
+            return native_return_kind::uint16;
+        else if (ty == &ffi_type_sint32)
+            return native_return_kind::sint32;
+        else if (ty == &ffi_type_uint32)
+            return native_return_kind::uint32;
+        else if (is_word(ty))
+            return native_return_kind::word;
+        else
+            return native_return_kind::_count;
+    }();
+    if (return_kind == native_return_kind::_count)
+        return nullptr;
+
+    return call_native_direct_builtins[arity][std::size_t(return_kind)];
+}
+
+// Returns the function type if ptr is a function pointer, nullptr otherwise.
+const clauf::function_type* get_function_pointee_type(const clauf::pointer_type* ptr)
+{
+    return dryad::node_try_cast<clauf::function_type>(
+        clauf::unqualified_type_of(ptr->pointee_type()));
+}
+
+clauf::native_callback* get_native_callback(clauf::code& code, const clauf::function_type* type)
+{
+    if (auto callback = code.lookup_native_callback(type))
+        return callback;
+
+    clauf::native_callback callback;
+    callback.type = type;
+
+    std::uint8_t input_count = 0;
+    for (auto param : type->parameters())
+    {
+        callback.argument_types.push_back(codegen_ffi_type(code, param));
+
+        auto ptr = dryad::node_try_cast<clauf::pointer_type>(param);
+        if (ptr != nullptr && clauf::is_complete_object_type(ptr->pointee_type()))
+            callback.argument_sizes.push_back(codegen_lauf_layout(ptr->pointee_type()).size);
+        else
+            callback.argument_sizes.push_back(native_allocation_cache::unknown_size);
+
+        ++input_count;
+    }
+    callback.return_type = codegen_ffi_type(code, type->return_type());
+    if (!clauf::is_void(type->return_type()) && !is_first_class_type(type->return_type()))
+        // Add one parameter for the return pointer.
+        ++input_count;
+    callback.signature
+        = {input_count, std::uint8_t(clauf::is_void(type->return_type()) ? 0 : 1)};
+
+    return code.add_native_callback(std::move(callback));
+}
+
+// Translates the argument of params[idx] on top of the vstack into the representation native code
+// expects.
+// The arguments of the parameters before it are below it, followed by the ones after it.
+void codegen_native_argument_translation(lauf_asm_builder* b, clauf::code& code,
+                                         const std::vector<const clauf::parameter_decl*>& params,
+                                         std::size_t                                      idx)
+{
+    auto ptr = dryad::node_try_cast<clauf::pointer_type>(params[idx]->type());
+    if (ptr == nullptr)
+        return;
+
+    if (auto fn_type = get_function_pointee_type(ptr))
+    {
+        // Native code can only call it through a closure.
+        auto callback = get_native_callback(code, fn_type);
+        lauf_asm_inst_bytes(b, &callback);
+        lauf_asm_inst_call_builtin(b, translate_function_to_pointer);
+        return;
+    }
+
+    switch (ptr->native())
+    {
+    case clauf::native_specifier::none:
+        break;
+    case clauf::native_specifier::default_:
+        lauf_asm_inst_call_builtin(b, translate_address_to_pointer);
+        break;
+    case clauf::native_specifier::string:
+        lauf_asm_inst_call_builtin(b, translate_address_to_string);
+        break;
+
+    case clauf::native_specifier::buffer: {
+        auto length_idx = std::size_t(0);
+        while (params[length_idx]->name() != params[idx]->native_buffer_length())
+            ++length_idx;
+
+        // Push a copy of the length argument.
+        if (length_idx < idx)
+            lauf_asm_inst_pick(b, std::uint16_t(idx - length_idx));
+        else
+            lauf_asm_inst_pick(b, std::uint16_t(idx + params.size() - length_idx));
+
+        if ((clauf::type_qualifiers_of(ptr->pointee_type()) & clauf::qualified_type::const_) != 0)
+            lauf_asm_inst_call_builtin(b, translate_address_to_const_buffer);
+        else
+            lauf_asm_inst_call_builtin(b, translate_address_to_buffer);
+        break;
+    }
+    }
+}
+
+// Truncates the integer argument on top of the vstack to its type and extends it to 64 bit again,
+// as native functions called directly expect.
+// Conversions to a narrower signed type check for overflow, so only unsigned ones are affected:
+// they don't generate any code, so the upper bits can still contain garbage.
+void codegen_native_argument_truncation(lauf_asm_builder* b, const clauf::type* type)
+{
+    auto lauf_type = codegen_lauf_type(type);
+    if (lauf_type == &lauf_lib_int_u8)
+        lauf_asm_inst_uint(b, 0xFF);
+    else if (lauf_type == &lauf_lib_int_u16)
+        lauf_asm_inst_uint(b, 0xFFFF);
+    else if (lauf_type == &lauf_lib_int_u32)
+        lauf_asm_inst_uint(b, 0xFFFF'FFFF);
+    else
+        return;
 
-    ffi_cif cif;
-    ffi_prep_cif(&cif, FFI_DEFAULT_ABI, unsigned(types.size()),
-                 codegen_ffi_type(decl->type()->return_type()), types.data());
+    lauf_asm_inst_call_builtin(b, lauf_lib_bits_and);
+}
 
-    // Find the native address of the function.
-    auto fn_addr = dlsym(RTLD_DEFAULT, decl->name().c_str(*ctx.symbols));
+bool requires_native_truncation(const clauf::type* type)
+{
+    auto lauf_type = codegen_lauf_type(type);
+    return lauf_type == &lauf_lib_int_u8 || lauf_type == &lauf_lib_int_u16
+           || lauf_type == &lauf_lib_int_u32;
+}
 
-    return code.add_ffi_function({cif, fn_addr, std::move(types)});
+bool requires_native_translation(const clauf::type* type)
+{
+    auto ptr = dryad::node_try_cast<clauf::pointer_type>(type);
+    return ptr != nullptr
+           && (ptr->native() != clauf::native_specifier::none
+               || get_function_pointee_type(ptr) != nullptr);
 }
 
 lauf_asm_function* codegen_native_trampoline(context& ctx, clauf::code& code,
-                                             const clauf::function_decl* decl)
+                                             const clauf::native_libraries& libraries,
+                                             const clauf::function_decl*    decl)
 {
     auto                                      fn = *ctx.functions->lookup(decl);
     std::vector<const clauf::parameter_decl*> params;
@@ -1606,90 +4010,343 @@ lauf_asm_function* codegen_native_trampoline(context& ctx, clauf::code& code,
     auto b = ctx.body_builder;
     lauf_asm_build(b, ctx.mod, fn);
 
-    // Create the argument array.
-    auto arguments
-        = lauf_asm_build_local(b, lauf_asm_array_layout(lauf_asm_type_value.layout, params.size()));
-
-    // We create variables for all parameters and store the value into them.
-    // Since parameters have been pushed onto the stack and are thus popped in reverse,
-    // we need to iterate in reverse order.
-    // We then store a pointer to the parameter in the arguments array.
-    for (auto iter = params.rbegin(); iter != params.rend(); ++iter)
+    // If the function returns a buffer, it stores its length into one of the parameters.
+    // We need to remember the address of it to read the length after the call.
+    lauf_asm_local*      return_length_ptr  = nullptr;
+    const lauf_asm_type* return_length_type = nullptr;
+    if (auto length_symbol = decl->native_buffer_length())
     {
-        auto param_decl = *iter;
-        auto type       = codegen_lauf_type(param_decl->type());
-
-        if (auto ptr = dryad::node_try_cast<clauf::pointer_type>(param_decl->type());
-            ptr != nullptr && ptr->native() == clauf::native_specifier::default_)
-            lauf_asm_inst_call_builtin(b, translate_address_to_pointer);
-        else if (ptr != nullptr && ptr->native() == clauf::native_specifier::string)
-            lauf_asm_inst_call_builtin(b, translate_address_to_string);
+        auto idx = std::size_t(0);
+        while (params[idx]->name() != length_symbol)
+            ++idx;
 
-        auto var = lauf_asm_build_local(b, type->layout);
-        lauf_asm_inst_local_addr(b, var);
-        lauf_asm_inst_store_field(b, *type, 0);
+        auto length_ptr_type = dryad::node_cast<clauf::pointer_type>(params[idx]->type());
+        return_length_type   = codegen_lauf_type(length_ptr_type->pointee_type());
 
-        lauf_asm_inst_local_addr(b, var);
-        lauf_asm_inst_local_addr(b, arguments);
-        lauf_asm_inst_uint(b, std::size_t(iter.base() - params.begin() - 1));
-        lauf_asm_inst_array_element(b, lauf_asm_type_value.layout);
+        return_length_ptr = lauf_asm_build_local(b, lauf_asm_type_value.layout);
+        lauf_asm_inst_pick(b, std::uint16_t(params.size() - 1 - idx));
+        lauf_asm_inst_local_addr(b, return_length_ptr);
         lauf_asm_inst_store_field(b, lauf_asm_type_value, 0);
     }
 
-    auto ffi_function = get_ffi_function(ctx, code, decl);
-    if (ffi_function->addr == nullptr)
+    auto ffi_function = get_ffi_function(ctx, code, libraries, decl);
+    auto direct       = get_direct_native_builtin(*ffi_function);
+
+    // Translate the arguments in place.
+    // The last parameter is on top of the vstack, so rolling brings the first one to the top.
+    // After rolling (and translating) each parameter once, they're back in the original order.
+    if (std::any_of(params.begin(), params.end(), [&](auto param) {
+            return requires_native_translation(param->type())
+                   || (direct != nullptr && requires_native_truncation(param->type()));
+        }))
     {
-        auto msg = lauf_asm_build_string_literal(b, "undefined reference to native function");
-        lauf_asm_inst_global_addr(b, msg);
-        lauf_asm_inst_panic(b);
+        for (auto idx = std::size_t(0); idx != params.size(); ++idx)
+        {
+            lauf_asm_inst_roll(b, std::uint16_t(params.size() - 1));
+            codegen_native_argument_translation(b, code, params, idx);
+            if (direct != nullptr)
+                codegen_native_argument_truncation(b, params[idx]->type());
+        }
     }
 
-    if (clauf::is_void(decl->type()->return_type()))
+    if (direct != nullptr)
     {
-        lauf_asm_inst_null(b);
-        lauf_asm_inst_local_addr(b, arguments);
+        // The arguments are already in place, we just need to push the function.
         lauf_asm_inst_bytes(b, &ffi_function);
-        lauf_asm_inst_call_builtin(b, call_native);
+        lauf_asm_inst_call_builtin(b, *direct);
     }
     else
     {
-        auto return_type  = codegen_lauf_type(decl->type()->return_type());
-        auto return_value = lauf_asm_build_local(b, return_type->layout);
+        // Create the argument array.
+        auto arguments = lauf_asm_build_local(b, lauf_asm_array_layout(lauf_asm_type_value.layout,
+                                                                       params.size()));
+
+        // We create variables for all parameters and store the value into them.
+        // Since parameters have been pushed onto the stack and are thus popped in reverse,
+        // we need to iterate in reverse order.
+        // We then store a pointer to the parameter in the arguments array.
+        // Structs are already passed by pointer, so we can give native code their address
+        // directly without copying them.
+        for (auto iter = params.rbegin(); iter != params.rend(); ++iter)
+        {
+            auto param_decl = *iter;
+            if (auto type = codegen_lauf_type(param_decl->type()))
+            {
+                auto var = lauf_asm_build_local(b, type->layout);
+                lauf_asm_inst_local_addr(b, var);
+                lauf_asm_inst_store_field(b, *type, 0);
+                lauf_asm_inst_local_addr(b, var);
+            }
 
-        lauf_asm_inst_local_addr(b, return_value);
-        lauf_asm_inst_local_addr(b, arguments);
-        lauf_asm_inst_bytes(b, &ffi_function);
-        lauf_asm_inst_call_builtin(b, call_native);
+            lauf_asm_inst_local_addr(b, arguments);
+            lauf_asm_inst_uint(b, std::size_t(iter.base() - params.begin() - 1));
+            lauf_asm_inst_array_element(b, lauf_asm_type_value.layout);
+            lauf_asm_inst_store_field(b, lauf_asm_type_value, 0);
+        }
+
+        if (clauf::is_void(decl->type()->return_type()))
+        {
+            lauf_asm_inst_null(b);
+            lauf_asm_inst_local_addr(b, arguments);
+            lauf_asm_inst_bytes(b, &ffi_function);
+            lauf_asm_inst_call_builtin(b, call_native);
+        }
+        else if (!is_first_class_type(decl->type()->return_type()))
+        {
+            // Only the return pointer is left on the stack; native code writes the struct
+            // directly into it and we return it afterwards.
+            lauf_asm_inst_pick(b, 0);
+            lauf_asm_inst_local_addr(b, arguments);
+            lauf_asm_inst_bytes(b, &ffi_function);
+            lauf_asm_inst_call_builtin(b, call_native);
+        }
+        else
+        {
+            // libffi writes a full register, so the local needs to be big enough for it.
+            auto return_type  = codegen_lauf_type(decl->type()->return_type());
+            auto return_value = lauf_asm_build_local(b, lauf_asm_type_value.layout);
 
-        lauf_asm_inst_local_addr(b, return_value);
-        lauf_asm_inst_load_field(b, *return_type, 0);
-        if (auto ptr = dryad::node_try_cast<clauf::pointer_type>(decl->type()->return_type());
-            ptr != nullptr && ptr->native() == clauf::native_specifier::default_)
-            lauf_asm_inst_call_builtin(b, translate_pointer_to_address);
-        else if (ptr != nullptr && ptr->native() == clauf::native_specifier::string)
-            lauf_asm_inst_call_builtin(b, translate_string_to_address);
+            lauf_asm_inst_local_addr(b, return_value);
+            lauf_asm_inst_local_addr(b, arguments);
+            lauf_asm_inst_bytes(b, &ffi_function);
+            lauf_asm_inst_call_builtin(b, call_native);
+
+            lauf_asm_inst_local_addr(b, return_value);
+            lauf_asm_inst_load_field(b, *return_type, 0);
+        }
+    }
+
+    if (auto ptr = dryad::node_try_cast<clauf::pointer_type>(decl->type()->return_type());
+        ptr != nullptr && ptr->native() == clauf::native_specifier::default_)
+    {
+        // If we know what the pointer points to, we know the size of the allocation.
+        if (clauf::is_complete_object_type(ptr->pointee_type()))
+            lauf_asm_inst_uint(b, codegen_lauf_layout(ptr->pointee_type()).size);
+        else
+            lauf_asm_inst_uint(b, native_allocation_cache::unknown_size);
+        lauf_asm_inst_call_builtin(b, translate_pointer_to_address);
+    }
+    else if (ptr != nullptr && ptr->native() == clauf::native_specifier::string)
+    {
+        lauf_asm_inst_call_builtin(b, translate_string_to_address);
+    }
+    else if (ptr != nullptr && ptr->native() == clauf::native_specifier::buffer)
+    {
+        // The function has stored the length for us, so we don't need to compute it.
+        lauf_asm_inst_local_addr(b, return_length_ptr);
+        lauf_asm_inst_load_field(b, lauf_asm_type_value, 0);
+        lauf_asm_inst_load_field(b, *return_length_type, 0);
+        lauf_asm_inst_call_builtin(b, translate_pointer_to_address);
     }
     lauf_asm_inst_return(b);
 
     lauf_asm_build_finish(b);
     return fn;
 }
+
+// Returns the builtin that implements a native function of the string library, or nullptr if there
+// is none or the function was declared with a different prototype.
+// Pointers declared with __clauf_native_string or __clauf_native_buffer() don't match: they
+// explicitly request how the native function is called.
+const lauf_runtime_builtin* get_library_builtin(context& ctx, const clauf::function_decl* decl)
+{
+    auto matches = [](const clauf::type* ty, library_type expected, bool is_return) {
+        ty = clauf::unqualified_type_of(ty);
+        switch (expected)
+        {
+        case library_type::void_:
+            return clauf::is_void(ty);
+        case library_type::pointer: {
+            auto ptr = dryad::node_try_cast<clauf::pointer_type>(ty);
+            return ptr != nullptr
+                   && (ptr->native() == clauf::native_specifier::none
+                       || ptr->native() == clauf::native_specifier::default_)
+                   && get_function_pointee_type(ptr) == nullptr;
+        }
+        case library_type::int_:
+            return is_return ? clauf::is_signed_int(ty) : clauf::is_integer(ty);
+        case library_type::size:
+            return is_return ? clauf::is_unsigned_int(ty) : clauf::is_integer(ty);
+        }
+        return false;
+    };
+
+    auto name = decl->name().c_str(*ctx.symbols);
+    for (auto& fn : library_functions)
+    {
+        if (std::strcmp(fn.name, name) != 0)
+            continue;
+
+        if (!matches(decl->type()->return_type(), fn.return_type, true))
+            return nullptr;
+
+        auto idx = std::size_t(0);
+        for (auto param : decl->parameters())
+        {
+            if (idx == fn.parameter_count || !matches(param->type(), fn.parameters[idx], false))
+                return nullptr;
+            ++idx;
+        }
+        return idx == fn.parameter_count ? fn.builtin : nullptr;
+    }
+
+    return nullptr;
+}
+
+// The arguments are already in the right order for the builtin, so we just call it.
+lauf_asm_function* codegen_library_trampoline(context& ctx, const clauf::function_decl* decl,
+                                              const lauf_runtime_builtin* builtin)
+{
+    auto fn = *ctx.functions->lookup(decl);
+
+    auto b = ctx.body_builder;
+    lauf_asm_build(b, ctx.mod, fn);
+    lauf_asm_inst_call_builtin(b, *builtin);
+    lauf_asm_inst_return(b);
+    lauf_asm_build_finish(b);
+
+    return fn;
+}
 } // namespace
 
+//=== native_libraries ===//
+clauf::native_libraries::~native_libraries()
+{
+    for (auto handle : _handles)
+        dlclose(handle);
+}
+
+std::optional<std::string> clauf::native_libraries::add(const char* path)
+{
+    auto handle = dlopen(path, RTLD_LAZY | RTLD_LOCAL);
+    if (handle == nullptr)
+        return dlerror();
+
+    _handles.push_back(handle);
+    return std::nullopt;
+}
+
+void* clauf::native_libraries::lookup(const char* symbol) const
+{
+    for (auto handle : _handles)
+        if (auto addr = dlsym(handle, symbol))
+            return addr;
+
+    return dlsym(RTLD_DEFAULT, symbol);
+}
+
+//=== builtin state ===//
+void clauf::reset_builtin_state()
+{
+    output_buffer.flush();
+
+    string_length_cache.process     = nullptr;
+    native_allocation_cache.process = nullptr;
+    string_length_cache.lengths.clear();
+    native_allocation_cache.entries.clear();
+
+    arena_table  = {};
+    map_table    = {};
+    vector_table = {};
+
+    file_mappings.process = nullptr;
+    file_mappings.unmap_all();
+
+    io_queue.process = nullptr;
+    io_queue.pending.clear();
+
+    // Everything the previous run allocated is gone, but the peak remains.
+    memory_report.process = nullptr;
+    memory_report.blocks.clear();
+    memory_report.heap.current_bytes          = 0;
+    memory_report.arenas.current_bytes        = 0;
+    memory_report.file_mappings.current_bytes = 0;
+}
+
+//=== memory report ===//
+void clauf::enable_memory_report()
+{
+    memory_report.enabled = true;
+}
+
+void clauf::print_memory_report()
+{
+    auto print_usage = [](const char* category, const memory_usage& usage) {
+        std::fprintf(stderr, "%-14s %12llu %12llu %12zu %12zu\n", category,
+                     static_cast<unsigned long long>(usage.allocations),
+                     static_cast<unsigned long long>(usage.frees), usage.current_bytes,
+                     usage.peak_bytes);
+    };
+
+    std::fprintf(stderr, "=== MEMORY ===\n");
+    std::fprintf(stderr, "%-14s %12s %12s %12s %12s\n", "category", "allocations", "frees",
+                 "current", "peak");
+    print_usage("heap", memory_report.heap);
+    print_usage("globals", memory_report.globals);
+    print_usage("arenas", memory_report.arenas);
+    print_usage("file mappings", memory_report.file_mappings);
+
+    // The memory lauf allocates for the program, like its stacks; the heap builtins above allocate
+    // from the same heap, but bypass lauf.
+    auto& vm = clauf::heap::stats();
+    print_usage("vm", {vm.allocations, vm.deallocations, vm.current_bytes, vm.peak_bytes});
+
+    if (memory_report.blocks.empty())
+        return;
+
+    // Group the leaked blocks by the site that allocated them, in source order.
+    std::map<std::uint64_t, memory_usage> leaks;
+    for (auto& [key, block] : memory_report.blocks)
+        leaks[block.site].allocated(block.size);
+
+    std::fprintf(stderr, "\n=== LEAKS ===\n");
+    for (auto& [site, usage] : leaks)
+        std::fprintf(stderr, "%s: %zu bytes in %llu blocks\n",
+                     memory_report.sites[site].c_str(), usage.current_bytes,
+                     static_cast<unsigned long long>(usage.allocations));
+}
+
 //=== codegen ===//
-clauf::codegen::codegen(lauf_vm* vm, diagnostic_logger& logger, const file& f,
-                        const ast_symbol_interner& sym)
-: _vm(vm), _logger(&logger), _file(&f), _symbols(&sym), _mod(lauf_asm_create_module("main module")),
+clauf::codegen::codegen(lauf_vm* vm, const native_libraries& libraries)
+: _vm(vm), _logger(nullptr), _file(nullptr), _symbols(nullptr), _debug_path(nullptr),
+  _libraries(&libraries),
+  _code(lauf_asm_create_module("main module")), _mod(_code.module()),
   _body_builder(lauf_asm_create_builder(lauf_asm_default_build_options)),
   _chunk_builder(lauf_asm_create_builder(lauf_asm_default_build_options)),
   _consteval_chunk(lauf_asm_create_chunk(_mod)),
   _consteval_result_global(lauf_asm_add_global(_mod, LAUF_ASM_GLOBAL_READ_WRITE))
 {
-    lauf_asm_set_module_debug_path(_mod, f.path());
     lauf_asm_set_global_debug_name(_mod, _consteval_result_global,
                                    "constexpr_initialization_result");
 }
 
+void clauf::codegen::set_translation_unit(diagnostic_logger& logger, const file& f,
+                                          const ast_symbol_interner& sym)
+{
+    // The module only has a single path, so the debug locations are relative to the first file.
+    // Statements of the other translation units get synthetic locations.
+    if (_debug_path == nullptr)
+    {
+        _debug_path = f.path();
+        lauf_asm_set_module_debug_path(_mod, _debug_path);
+    }
+
+    _logger  = &logger;
+    _file    = &f;
+    _symbols = &sym;
+}
+
+const char* clauf::codegen::name_of(const decl* decl)
+{
+    auto name = decl->name().c_str(*_symbols);
+    if (decl->linkage() != clauf::linkage::internal)
+        return name;
+
+    // Translation units can have internal declarations of the same name, so they are qualified by
+    // the path of their unit.
+    return _code.add_name(std::string(_file->path()) + ":" + name);
+}
+
 void clauf::codegen::declare_global(const variable_decl* decl)
 {
     if (!decl->is_definition())
@@ -1700,8 +4357,9 @@ void clauf::codegen::declare_global(const variable_decl* decl)
 
     auto global = lauf_asm_add_global(_mod, is_const ? LAUF_ASM_GLOBAL_READ_ONLY
                                                      : LAUF_ASM_GLOBAL_READ_WRITE);
-    lauf_asm_set_global_debug_name(_mod, global, decl->name().c_str(*_symbols));
+    lauf_asm_set_global_debug_name(_mod, global, name_of(decl));
     _globals.insert(decl, global);
+    memory_report.globals.allocated(codegen_lauf_layout(decl->type()).size);
 
     if (decl->is_constexpr())
     {
@@ -1711,6 +4369,7 @@ void clauf::codegen::declare_global(const variable_decl* decl)
                     _logger,
                     _symbols,
                     _file,
+                    _debug_path,
                     _mod,
                     _consteval_chunk,
                     _consteval_result_global,
@@ -1728,6 +4387,16 @@ void clauf::codegen::declare_function(const function_decl* decl)
     if (!decl->is_definition() && decl->linkage() != clauf::linkage::native)
         return;
 
+    if (decl->linkage() == clauf::linkage::native)
+    {
+        auto [iter, inserted] = _native_functions.emplace(decl->name().c_str(*_symbols), decl);
+        if (!inserted)
+        {
+            _functions.insert(decl, *_functions.lookup(iter->second));
+            return;
+        }
+    }
+
     auto parameter_count = std::distance(decl->parameters().begin(), decl->parameters().end());
     auto return_count    = [&] {
         auto return_type = decl->type()->return_type();
@@ -1748,10 +4417,9 @@ void clauf::codegen::declare_function(const function_decl* decl)
         }
     }();
 
-    auto name = decl->name().c_str(*_symbols);
-    auto fn   = lauf_asm_add_function(_mod, name,
-                                      {static_cast<std::uint8_t>(parameter_count),
-                                       static_cast<std::uint8_t>(return_count)});
+    auto fn = lauf_asm_add_function(_mod, name_of(decl),
+                                    {static_cast<std::uint8_t>(parameter_count),
+                                     static_cast<std::uint8_t>(return_count)});
     _functions.insert(decl, fn);
     if (decl->linkage() == clauf::linkage::external)
         lauf_asm_export_function(fn);
@@ -1767,6 +4435,7 @@ try
                 _logger,
                 _symbols,
                 _file,
+                _debug_path,
                 _mod,
                 _consteval_chunk,
                 _consteval_result_global,
@@ -1785,13 +4454,16 @@ catch (std::runtime_error&)
     return 0;
 }
 
-std::optional<clauf::code> clauf::codegen::finish(const ast& ast) &&
+bool clauf::codegen::define(diagnostic_logger& logger, const ast& ast)
 try
 {
-    context     ctx{_vm,
+    set_translation_unit(logger, ast.input, ast.symbols);
+
+    context ctx{_vm,
                 _logger,
                 _symbols,
                 _file,
+                _debug_path,
                 _mod,
                 _consteval_chunk,
                 _consteval_result_global,
@@ -1799,8 +4471,7 @@ try
                 _chunk_builder,
                 &_globals,
                 &_functions,
-                    {}};
-    clauf::code code(_mod);
+                {}};
 
     // Generate body for all lauf declarations.
     dryad::visit_tree(
@@ -1817,14 +4488,21 @@ try
         [&](const function_decl* decl) {
             if (decl->is_definition())
                 codegen_function_body(ctx, decl);
-            else if (decl->linkage() == clauf::linkage::native)
-                codegen_native_trampoline(ctx, code, decl);
+            else if (decl->linkage() == clauf::linkage::native
+                     && _native_functions[decl->name().c_str(*_symbols)] == decl)
+            {
+                // Functions of the string library are implemented by builtins.
+                if (auto builtin = get_library_builtin(ctx, decl))
+                    codegen_library_trampoline(ctx, decl, builtin);
+                else
+                    codegen_native_trampoline(ctx, _code, *_libraries, decl);
+            }
         });
 
-    return code;
+    return true;
 }
 catch (std::runtime_error&)
 {
-    return std::nullopt;
+    return false;
 }
 
@@ -3,12 +3,19 @@
 
 #include <clauf/compiler.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <dryad/symbol_table.hpp>
 #include <lexy/action/parse.hpp>
 #include <lexy/callback.hpp>
 #include <lexy/dsl.hpp>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -37,30 +44,107 @@ struct scope
         // The scope of a struct declaration.
         struct_,
     } kind;
-    dryad::symbol_table<clauf::ast_symbol, clauf::decl*> symbols;
-    scope*                                               parent;
+    scope* parent;
 
     scope(kind_t kind, scope* parent) : kind(kind), parent(parent) {}
 };
 
+// The declarations visible in the current scope.
+//
+// Instead of a table per scope, there is a single table that maps each symbol to the innermost
+// declaration of it, so lookup is a single probe regardless of nesting.
+// The declarations it shadows are kept in a linked list and restored when the scope is left.
+class scoped_symbol_table
+{
+public:
+    // Struct tags are in a separate namespace from ordinary identifiers.
+    enum namespace_t
+    {
+        ordinary,
+        tag,
+    };
+
+    clauf::decl* lookup(namespace_t ns, clauf::ast_symbol symbol) const
+    {
+        auto entry = _tables[ns].lookup(symbol);
+        return entry == nullptr ? nullptr : entry->decl;
+    }
+
+    // Inserts a declaration in the current scope.
+    // If there already is one for the symbol in the current scope, it is replaced and returned.
+    clauf::decl* insert_or_shadow(namespace_t ns, clauf::ast_symbol symbol, clauf::decl* decl)
+    {
+        auto shadowed = _tables[ns].lookup(symbol);
+        if (shadowed != nullptr && shadowed->depth == _depth)
+        {
+            auto result    = shadowed->decl;
+            shadowed->decl = decl;
+            return result;
+        }
+
+        _entries.push_back({ns, symbol, _depth, decl, shadowed});
+        _tables[ns].insert_or_shadow(symbol, &_entries.back());
+        return nullptr;
+    }
+
+    void enter_scope()
+    {
+        ++_depth;
+    }
+
+    // Removes all declarations of the current scope.
+    void leave_scope()
+    {
+        while (!_entries.empty() && _entries.back().depth == _depth)
+        {
+            auto& entry = _entries.back();
+            if (entry.shadowed == nullptr)
+                _tables[entry.ns].remove(entry.symbol);
+            else
+                _tables[entry.ns].insert_or_shadow(entry.symbol, entry.shadowed);
+            _entries.pop_back();
+        }
+        --_depth;
+    }
+
+private:
+    struct entry
+    {
+        namespace_t       ns;
+        clauf::ast_symbol symbol;
+        std::size_t       depth;
+        clauf::decl*      decl;
+        entry*            shadowed;
+    };
+
+    // The entries in the order they were added, which doubles as the log of what to undo when a
+    // scope is left.
+    std::deque<entry>                              _entries;
+    dryad::symbol_table<clauf::ast_symbol, entry*> _tables[2];
+    std::size_t                                    _depth = 0;
+};
+
 struct compiler_state
 {
     clauf::ast                                    ast;
     dryad::unlinked_node_list<clauf::struct_decl> structs;
     clauf::diagnostic_logger                      logger;
     dryad::tree<clauf::declarator>                decl_tree;
-    clauf::codegen                                codegen;
+    clauf::codegen&                               codegen;
 
     scope                 global_scope;
     scope*                current_scope;
+    scoped_symbol_table   symbols;
     clauf::function_decl* current_function = nullptr;
 
     int symbol_generator_count;
 
-    compiler_state(lauf_vm* vm, clauf::file&& input)
-    : ast{LEXY_MOV(input)}, logger(ast.input), codegen(vm, logger, ast.input, ast.symbols),
+    compiler_state(clauf::codegen& codegen, clauf::file&& input)
+    : ast{LEXY_MOV(input)}, logger(ast.input), codegen(codegen),
       global_scope(scope::global, nullptr), current_scope(&global_scope), symbol_generator_count(0)
-    {}
+    {
+        codegen.set_translation_unit(logger, ast.input, ast.symbols);
+    }
 
     clauf::ast_symbol generate_symbol()
     {
@@ -68,27 +152,25 @@ struct compiler_state
         ++symbol_generator_count;
         return ast.symbols.intern(str.c_str(), str.size());
     }
-};
 
-clauf::ast_symbol get_struct_name(compiler_state& state, clauf::ast_symbol name)
-{
-    auto str         = name.c_str(state.ast.symbols);
-    auto struct_name = std::string("struct ") + str;
-    return state.ast.symbols.intern(struct_name.c_str(), struct_name.length());
-}
+    void enter_scope(scope& s)
+    {
+        CLAUF_ASSERT(s.parent == current_scope, "scope must be nested in the current one");
+        current_scope = &s;
+        symbols.enter_scope();
+    }
+    void leave_scope()
+    {
+        symbols.leave_scope();
+        current_scope = current_scope->parent;
+    }
+};
 
 clauf::decl* name_lookup(compiler_state& state, bool is_struct, clauf::name name)
 {
-    auto symbol = is_struct ? get_struct_name(state, name.symbol) : name.symbol;
-
-    clauf::decl* decl = nullptr;
-    for (auto scope = state.current_scope; scope != nullptr; scope = scope->parent)
-    {
-        decl = scope->symbols.lookup(symbol);
-        if (decl != nullptr)
-            break;
-    }
-    return decl;
+    return state.symbols.lookup(is_struct ? scoped_symbol_table::tag
+                                          : scoped_symbol_table::ordinary,
+                                name.symbol);
 }
 
 void insert_new_decl(compiler_state& state, clauf::decl* decl)
@@ -102,10 +184,10 @@ void insert_new_decl(compiler_state& state, clauf::decl* decl)
             .finish();
     }
 
-    auto name     = dryad::node_has_kind<clauf::struct_decl>(decl)
-                        ? get_struct_name(state, decl->name())
-                        : decl->name();
-    auto shadowed = state.current_scope->symbols.insert_or_shadow(name, decl);
+    auto ns       = dryad::node_has_kind<clauf::struct_decl>(decl) ? scoped_symbol_table::tag
+                                                                   : scoped_symbol_table::ordinary;
+    auto name     = decl->name();
+    auto shadowed = state.symbols.insert_or_shadow(ns, name, decl);
     if (shadowed == nullptr)
         return;
 
@@ -133,8 +215,7 @@ void insert_new_decl(compiler_state& state, clauf::decl* decl)
     else if (shadowed->is_definition() && !decl->is_definition())
     {
         // Put the definition back into the symbol table.
-        [[maybe_unused]] auto result
-            = state.current_scope->symbols.insert_or_shadow(name, shadowed);
+        [[maybe_unused]] auto result = state.symbols.insert_or_shadow(ns, name, shadowed);
         CLAUF_ASSERT(result == decl, "decl is the one we inserted above");
     }
 }
@@ -212,6 +293,14 @@ clauf::expr* do_assignment_conversion(compiler_state& state, clauf::location loc
     {
         return state.ast.create<clauf::cast_expr>(loc, target_type, value);
     }
+    else if (auto target_ptr
+             = dryad::node_try_cast<clauf::pointer_type>(clauf::unqualified_type_of(target_type));
+             target_ptr != nullptr && dryad::node_has_kind<clauf::function_type>(value->type())
+             && clauf::is_same(target_ptr->pointee_type(), value->type()))
+    {
+        // A function is converted to a pointer to the function.
+        return state.ast.create<clauf::cast_expr>(loc, target_type, value);
+    }
     else if (clauf::is_pointer(target_type) && clauf::is_pointer(value->type()))
     {
         auto target_pointee_type
@@ -402,7 +491,8 @@ enum class simple_decl_specifier
     restrict_,
 };
 
-using decl_specifier = std::variant<simple_decl_specifier, clauf::struct_decl*>;
+// A clauf::name is the length parameter of a native buffer specifier.
+using decl_specifier = std::variant<simple_decl_specifier, clauf::struct_decl*, clauf::name>;
 
 constexpr auto kw_type_qualifiers
     = lexy::symbol_table<simple_decl_specifier> //
@@ -428,11 +518,73 @@ constexpr auto kw_decl_specifiers
 
 constexpr auto kw_struct = LEXY_KEYWORD("struct", id);
 
+constexpr auto kw_native_buffer = LEXY_KEYWORD("__clauf_native_buffer", id);
+
 constexpr auto kw_builtin_exprs = lexy::symbol_table<clauf::builtin_expr::builtin_t> //
                                       .map(LEXY_LIT("__clauf_print"), clauf::builtin_expr::print)
                                       .map(LEXY_LIT("__clauf_assert"), clauf::builtin_expr::assert)
                                       .map(LEXY_LIT("__clauf_malloc"), clauf::builtin_expr::malloc)
-                                      .map(LEXY_LIT("__clauf_free"), clauf::builtin_expr::free);
+                                      .map(LEXY_LIT("__clauf_free"), clauf::builtin_expr::free)
+                                      .map(LEXY_LIT("__clauf_realloc"),
+                                           clauf::builtin_expr::realloc)
+                                      .map(LEXY_LIT("__clauf_calloc"), clauf::builtin_expr::calloc)
+                                      .map(LEXY_LIT("__clauf_arena_create"),
+                                           clauf::builtin_expr::arena_create)
+                                      .map(LEXY_LIT("__clauf_arena_alloc"),
+                                           clauf::builtin_expr::arena_alloc)
+                                      .map(LEXY_LIT("__clauf_arena_reset"),
+                                           clauf::builtin_expr::arena_reset)
+                                      .map(LEXY_LIT("__clauf_arena_destroy"),
+                                           clauf::builtin_expr::arena_destroy)
+                                      .map(LEXY_LIT("__clauf_printf"), clauf::builtin_expr::printf)
+                                      .map(LEXY_LIT("__clauf_sprintf"),
+                                           clauf::builtin_expr::sprintf)
+                                      .map(LEXY_LIT("__clauf_puts"), clauf::builtin_expr::puts)
+                                      .map(LEXY_LIT("__clauf_map_file"),
+                                           clauf::builtin_expr::map_file)
+                                      .map(LEXY_LIT("__clauf_unmap_file"),
+                                           clauf::builtin_expr::unmap_file)
+                                      .map(LEXY_LIT("__clauf_map_create"),
+                                           clauf::builtin_expr::map_create)
+                                      .map(LEXY_LIT("__clauf_map_destroy"),
+                                           clauf::builtin_expr::map_destroy)
+                                      .map(LEXY_LIT("__clauf_map_size"),
+                                           clauf::builtin_expr::map_size)
+                                      .map(LEXY_LIT("__clauf_map_insert"),
+                                           clauf::builtin_expr::map_insert)
+                                      .map(LEXY_LIT("__clauf_map_find"),
+                                           clauf::builtin_expr::map_find)
+                                      .map(LEXY_LIT("__clauf_map_erase"),
+                                           clauf::builtin_expr::map_erase)
+                                      .map(LEXY_LIT("__clauf_map_insert_bytes"),
+                                           clauf::builtin_expr::map_insert_bytes)
+                                      .map(LEXY_LIT("__clauf_map_find_bytes"),
+                                           clauf::builtin_expr::map_find_bytes)
+                                      .map(LEXY_LIT("__clauf_map_erase_bytes"),
+                                           clauf::builtin_expr::map_erase_bytes)
+                                      .map(LEXY_LIT("__clauf_vector_create"),
+                                           clauf::builtin_expr::vector_create)
+                                      .map(LEXY_LIT("__clauf_vector_destroy"),
+                                           clauf::builtin_expr::vector_destroy)
+                                      .map(LEXY_LIT("__clauf_vector_size"),
+                                           clauf::builtin_expr::vector_size)
+                                      .map(LEXY_LIT("__clauf_vector_push"),
+                                           clauf::builtin_expr::vector_push)
+                                      .map(LEXY_LIT("__clauf_vector_pop"),
+                                           clauf::builtin_expr::vector_pop)
+                                      .map(LEXY_LIT("__clauf_vector_get"),
+                                           clauf::builtin_expr::vector_get)
+                                      .map(LEXY_LIT("__clauf_vector_set"),
+                                           clauf::builtin_expr::vector_set)
+                                      .map(LEXY_LIT("__clauf_sort"), clauf::builtin_expr::sort)
+                                      .map(LEXY_LIT("__clauf_io_submit_read"),
+                                           clauf::builtin_expr::io_submit_read)
+                                      .map(LEXY_LIT("__clauf_io_submit_write"),
+                                           clauf::builtin_expr::io_submit_write)
+                                      .map(LEXY_LIT("__clauf_io_wait"),
+                                           clauf::builtin_expr::io_wait)
+                                      .map(LEXY_LIT("__clauf_bench"), clauf::builtin_expr::bench)
+                                      .map(LEXY_LIT("__clauf_now_ns"), clauf::builtin_expr::now_ns);
 
 template <bool AllowReserved>
 struct identifier
@@ -442,7 +594,7 @@ struct identifier
     static constexpr auto rule
         = id.reserve(kw_nullptr, dsl::literal_set(kw_type_ops), kw_return, kw_break, kw_continue,
                      kw_if, kw_else, kw_while, kw_do, dsl::literal_set(kw_decl_specifiers),
-                     dsl::literal_set(kw_type_qualifiers), kw_struct,
+                     dsl::literal_set(kw_type_qualifiers), kw_struct, kw_native_buffer,
                      dsl::literal_set(kw_builtin_exprs));
     static constexpr auto value = callback<clauf::name>([](compiler_state& state, auto lexeme) {
         auto symbol = state.ast.symbols.intern(lexeme.data(), lexeme.size());
@@ -649,6 +801,7 @@ struct type_with_specs
     std::optional<clauf::storage_duration> storage_duration;
     bool                                   is_constexpr;
     bool                                   is_typedef;
+    std::optional<clauf::name>             native_buffer_length;
 
     bool is_valid_for_parameter_or_member() const
     {
@@ -716,29 +869,245 @@ struct type_name_in_parens
 
 struct expr;
 
+// Verifies that the format argument of a builtin is a valid format string literal.
+// Returns the kinds of its conversions.
+std::vector<clauf::format_directive::kind_t> verify_format_string(compiler_state& state,
+                                                                  clauf::expr*    format)
+{
+    auto loc = state.ast.input.location_of(format);
+
+    const clauf::string_literal_expr* literal = nullptr;
+    if (auto decay = dryad::node_try_cast<clauf::decay_expr>(format))
+        literal = dryad::node_try_cast<clauf::string_literal_expr>(decay->child());
+    if (literal == nullptr)
+    {
+        state.logger.log(clauf::diagnostic_kind::error, "format must be a string literal")
+            .annotation(clauf::annotation_kind::primary, loc, "here")
+            .finish();
+        return {};
+    }
+
+    auto directives = clauf::parse_format_string(literal->value());
+    if (!directives)
+    {
+        state.logger.log(clauf::diagnostic_kind::error, "invalid or unsupported format string")
+            .annotation(clauf::annotation_kind::primary, loc, "here")
+            .finish();
+        return {};
+    }
+
+    std::vector<clauf::format_directive::kind_t> result;
+    for (auto& directive : *directives)
+        if (directive.kind != clauf::format_directive::literal)
+            result.push_back(directive.kind);
+    return result;
+}
+
+// Converts the argument of a format builtin to the type expected by its conversion.
+clauf::expr* do_format_conversion(compiler_state& state, clauf::location loc,
+                                  clauf::format_directive::kind_t kind, clauf::expr* argument)
+{
+    if (kind == clauf::format_directive::string)
+    {
+        auto ptr = dryad::node_try_cast<clauf::pointer_type>(
+            clauf::unqualified_type_of(argument->type()));
+        if (ptr != nullptr && clauf::is_char(ptr->pointee_type()))
+            return argument;
+    }
+    else if (clauf::is_integer(argument->type()))
+    {
+        // We convert to 64 bit, so the builtins see the properly extended value.
+        auto is_signed
+            = kind == clauf::format_directive::sint || kind == clauf::format_directive::char_;
+        auto target = is_signed ? clauf::builtin_type::sint64 : clauf::builtin_type::uint64;
+        return do_assignment_conversion(state, loc, clauf::assignment_op::none,
+                                        state.ast.create(target), argument);
+    }
+
+    state.logger.log(clauf::diagnostic_kind::error, "argument does not match its conversion")
+        .annotation(clauf::annotation_kind::primary, loc, "here")
+        .finish();
+    return argument;
+}
+
 struct builtin_expr
 {
-    static constexpr auto rule
-        = dsl::position(dsl::symbol<kw_builtin_exprs>) >> dsl::parenthesized(dsl::recurse<expr>);
+    static constexpr auto rule = dsl::position(dsl::symbol<kw_builtin_exprs>)
+                                 >> LEXY_LIT("(") >> dsl::p<argument_list>;
     static constexpr auto value = callback<clauf::builtin_expr*>(
         [](compiler_state& state, const char* pos, clauf::builtin_expr::builtin_t builtin,
-           clauf::expr* child) {
-            child = do_lvalue_conversion(state, pos, child);
+           clauf::expr_list arguments) {
+            // Returns a pointer to the builtin type, which might be const.
+            auto pointer_to = [&](clauf::builtin_type::type_kind_t kind, bool is_const) {
+                return state.ast.types.build([&](clauf::type_forest::node_creator creator) {
+                    clauf::type* pointee = creator.create<clauf::builtin_type>(kind);
+                    if (is_const)
+                        pointee
+                            = creator.create<clauf::qualified_type>(clauf::qualified_type::const_,
+                                                                    pointee);
+                    return creator.create<clauf::pointer_type>(clauf::native_specifier::none,
+                                                               pointee);
+                });
+            };
 
-            auto type = [&]() -> const clauf::type* {
-                if (builtin == clauf::builtin_expr::malloc)
-                    return state.ast.types.build([&](clauf::type_forest::node_creator creator) {
-                        auto void_
-                            = creator.create<clauf::builtin_type>(clauf::builtin_type::void_);
-                        return creator.create<clauf::pointer_type>(clauf::native_specifier::none,
-                                                                   void_);
-                    });
-                else
+            auto void_          = state.ast.create(clauf::builtin_type::void_);
+            auto sint64         = state.ast.create(clauf::builtin_type::sint64);
+            auto uint64         = state.ast.create(clauf::builtin_type::uint64);
+            auto void_ptr       = pointer_to(clauf::builtin_type::void_, false);
+            auto const_void_ptr = pointer_to(clauf::builtin_type::void_, true);
+            auto char_ptr       = pointer_to(clauf::builtin_type::char_, false);
+            auto const_char_ptr = pointer_to(clauf::builtin_type::char_, true);
+            auto uint64_ptr     = pointer_to(clauf::builtin_type::uint64, false);
+            auto sint64_ptr     = pointer_to(clauf::builtin_type::sint64, false);
+
+            // The function called by a benchmark with a context pointer: void (*)(void* ctx).
+            auto bench_fn_ptr
+                = state.ast.types.build([&](clauf::type_forest::node_creator creator) {
+                      clauf::type_list parameters;
+                      parameters.push_back(creator.create<clauf::pointer_type>(
+                          clauf::native_specifier::none,
+                          creator.create<clauf::builtin_type>(clauf::builtin_type::void_)));
+
+                      auto fn = creator.create<clauf::function_type>(
+                          creator.create<clauf::builtin_type>(clauf::builtin_type::void_),
+                          parameters);
+                      return creator.create<clauf::pointer_type>(clauf::native_specifier::none,
+                                                                 fn);
+                  });
+
+            // A parameter type of nullptr accepts any argument without conversion.
+            // Arenas, maps and vectors are referred to by an integer handle.
+            // The format string is the last parameter and determines the remaining arguments.
+            struct signature
+            {
+                const clauf::type*              return_type;
+                std::vector<const clauf::type*> parameters;
+                bool                            has_format = false;
+            };
+            auto sig = [&]() -> signature {
+                switch (builtin)
                 {
-                    return state.ast.create(clauf::builtin_type::void_);
+                case clauf::builtin_expr::print:
+                case clauf::builtin_expr::assert:
+                    return {void_, {nullptr}};
+                case clauf::builtin_expr::malloc:
+                    return {void_ptr, {nullptr}};
+                case clauf::builtin_expr::free:
+                    return {void_, {nullptr}};
+                case clauf::builtin_expr::realloc:
+                    return {void_ptr, {void_ptr, uint64}};
+                case clauf::builtin_expr::calloc:
+                    return {void_ptr, {uint64, uint64}};
+                case clauf::builtin_expr::arena_create:
+                    return {uint64, {}};
+                case clauf::builtin_expr::arena_alloc:
+                    return {void_ptr, {uint64, uint64}};
+                case clauf::builtin_expr::arena_reset:
+                case clauf::builtin_expr::arena_destroy:
+                    return {void_, {uint64}};
+                case clauf::builtin_expr::printf:
+                    return {sint64, {nullptr}, true};
+                case clauf::builtin_expr::sprintf:
+                    return {sint64, {char_ptr, nullptr}, true};
+                case clauf::builtin_expr::puts:
+                    return {sint64, {const_char_ptr}};
+                case clauf::builtin_expr::map_file:
+                    return {const_void_ptr, {const_char_ptr, uint64_ptr}};
+                case clauf::builtin_expr::unmap_file:
+                    return {void_, {const_void_ptr}};
+                case clauf::builtin_expr::map_create:
+                case clauf::builtin_expr::vector_create:
+                    return {uint64, {}};
+                case clauf::builtin_expr::map_destroy:
+                case clauf::builtin_expr::vector_destroy:
+                    return {void_, {uint64}};
+                case clauf::builtin_expr::map_size:
+                case clauf::builtin_expr::vector_size:
+                    return {uint64, {uint64}};
+                case clauf::builtin_expr::map_insert:
+                    return {sint64, {uint64, uint64, uint64}};
+                case clauf::builtin_expr::map_find:
+                    return {sint64, {uint64, uint64, uint64_ptr}};
+                case clauf::builtin_expr::map_erase:
+                    return {sint64, {uint64, uint64}};
+                case clauf::builtin_expr::map_insert_bytes:
+                    return {sint64, {uint64, const_void_ptr, uint64, uint64}};
+                case clauf::builtin_expr::map_find_bytes:
+                    return {sint64, {uint64, const_void_ptr, uint64, uint64_ptr}};
+                case clauf::builtin_expr::map_erase_bytes:
+                    return {sint64, {uint64, const_void_ptr, uint64}};
+                case clauf::builtin_expr::vector_push:
+                    return {void_, {uint64, uint64}};
+                case clauf::builtin_expr::vector_pop:
+                    return {uint64, {uint64}};
+                case clauf::builtin_expr::vector_get:
+                    return {uint64, {uint64, uint64}};
+                case clauf::builtin_expr::vector_set:
+                    return {void_, {uint64, uint64, uint64}};
+                case clauf::builtin_expr::sort:
+                    return {void_, {void_ptr, uint64, uint64, uint64, uint64, sint64}};
+                case clauf::builtin_expr::io_submit_read:
+                    return {uint64, {sint64, void_ptr, uint64, uint64}};
+                case clauf::builtin_expr::io_submit_write:
+                    return {uint64, {sint64, const_void_ptr, uint64, uint64}};
+                case clauf::builtin_expr::io_wait:
+                    return {uint64, {sint64_ptr, uint64}};
+                case clauf::builtin_expr::bench:
+                    return {void_, {const_char_ptr, bench_fn_ptr, void_ptr}};
+                case clauf::builtin_expr::now_ns:
+                    return {uint64, {}};
                 }
+                CLAUF_UNREACHABLE("invalid builtin");
+                return {};
             }();
-            return state.ast.create<clauf::builtin_expr>(pos, type, builtin, child);
+
+            clauf::expr_list converted_arguments;
+            auto             cur_param = sig.parameters.begin();
+            while (!arguments.empty() && cur_param != sig.parameters.end())
+            {
+                auto argument = arguments.pop_front();
+                auto loc      = state.ast.input.location_of(argument);
+                argument      = do_lvalue_conversion(state, loc, argument);
+                if (*cur_param != nullptr)
+                    argument = do_assignment_conversion(state, loc, clauf::assignment_op::none,
+                                                        *cur_param, argument);
+                converted_arguments.push_back(argument);
+
+                ++cur_param;
+            }
+            if (sig.has_format && cur_param == sig.parameters.end())
+            {
+                auto format = verify_format_string(state, converted_arguments.back());
+                while (!arguments.empty() && !format.empty())
+                {
+                    auto argument = arguments.pop_front();
+                    auto loc      = state.ast.input.location_of(argument);
+                    argument      = do_lvalue_conversion(state, loc, argument);
+                    argument      = do_format_conversion(state, loc, format.front(), argument);
+                    converted_arguments.push_back(argument);
+
+                    format.erase(format.begin());
+                }
+                if (!arguments.empty() || !format.empty())
+                {
+                    state.logger
+                        .log(clauf::diagnostic_kind::error,
+                             "mismatched number of conversions and arguments in format call")
+                        .annotation(clauf::annotation_kind::primary, pos, "call here")
+                        .finish();
+                }
+            }
+            else if (!arguments.empty() || cur_param != sig.parameters.end())
+            {
+                state.logger
+                    .log(clauf::diagnostic_kind::error,
+                         "mismatched number of parameters and arguments in builtin call")
+                    .annotation(clauf::annotation_kind::primary, pos, "call here")
+                    .finish();
+            }
+
+            return state.ast.create<clauf::builtin_expr>(pos, sig.return_type, builtin,
+                                                         converted_arguments);
         });
 };
 
@@ -1458,12 +1827,12 @@ struct secondary_block : lexy::scan_production<clauf::stmt*>
     static scan_result scan(lexy::rule_scanner<Context, Reader>& scanner, compiler_state& state)
     {
         scope local_scope(Kind, state.current_scope);
-        state.current_scope = &local_scope;
+        state.enter_scope(local_scope);
 
         scan_result result;
         scanner.parse(result, dsl::recurse<stmt>);
 
-        state.current_scope = state.current_scope->parent;
+        state.leave_scope();
         return result;
     }
 };
@@ -1521,11 +1890,11 @@ struct block_stmt : lexy::scan_production<clauf::block_stmt*>
     static scan_result scan(lexy::rule_scanner<Context, Reader>& scanner, compiler_state& state)
     {
         scope local_scope(scope::local, state.current_scope);
-        state.current_scope = &local_scope;
+        state.enter_scope(local_scope);
 
         auto result = scanner.parse(impl{});
 
-        state.current_scope = state.current_scope->parent;
+        state.leave_scope();
         return result;
     }
 };
@@ -1557,6 +1926,14 @@ namespace clauf::grammar
 struct parameter_list;
 struct struct_specifier;
 
+// `__clauf_native_buffer(length)`: a native pointer parameter to a buffer of `length` bytes,
+// where `length` is another parameter of the function.
+struct native_buffer_specifier
+{
+    static constexpr auto rule  = kw_native_buffer >> dsl::parenthesized(dsl::p<identifier<true>>);
+    static constexpr auto value = lexy::forward<clauf::name>;
+};
+
 struct decl_specifier_list
 {
     enum class base_type_t
@@ -1576,8 +1953,9 @@ struct decl_specifier_list
         std::optional<std::variant<base_type_t, clauf::decl_type*>> base_type;
         std::optional<bool>                                         is_signed;
         int                                                         short_count = 0;
-        int                     qualifiers = clauf::qualified_type::unqualified;
-        clauf::native_specifier native     = clauf::native_specifier::none;
+        int                        qualifiers = clauf::qualified_type::unqualified;
+        clauf::native_specifier    native     = clauf::native_specifier::none;
+        std::optional<clauf::name> native_buffer_length;
 
         list() {} // workaround clang compiler bug
 
@@ -1688,6 +2066,16 @@ struct decl_specifier_list
             return true;
         }
 
+        bool add_native_buffer(clauf::name length)
+        {
+            if (linkage.has_value() || native != clauf::native_specifier::none)
+                return false;
+            linkage              = clauf::linkage::native;
+            native               = clauf::native_specifier::buffer;
+            native_buffer_length = length;
+            return true;
+        }
+
         bool add_struct(compiler_state& state, clauf::struct_decl* struct_decl)
         {
             if (base_type)
@@ -1789,13 +2177,14 @@ struct decl_specifier_list
             if (type == nullptr)
                 return std::nullopt;
 
-            return type_with_specs{type,         native,    linkage, storage_duration,
-                                   is_constexpr, is_typedef};
+            return type_with_specs{type,         native,     linkage, storage_duration,
+                                   is_constexpr, is_typedef, native_buffer_length};
         }
     };
 
-    static constexpr auto rule = dsl::position(
-        dsl::list(dsl::symbol<kw_decl_specifiers> | dsl::recurse_branch<struct_specifier>));
+    static constexpr auto rule
+        = dsl::position(dsl::list(dsl::p<native_buffer_specifier> | dsl::symbol<kw_decl_specifiers>
+                                  | dsl::recurse_branch<struct_specifier>));
 
     static constexpr auto value
         = lexy::as_list<std::vector<decl_specifier>> >> callback<type_with_specs>(
@@ -1821,6 +2210,11 @@ struct decl_specifier_list
                           if (!result.add_struct(state, *struct_))
                               log_error();
                       }
+                      else if (auto length = std::get_if<clauf::name>(&spec))
+                      {
+                          if (!result.add_native_buffer(*length))
+                              log_error();
+                      }
                   }
 
                   if (auto specs = result.get_type_with_specs(state))
@@ -1908,6 +2302,30 @@ struct declarator : lexy::expression_production
         },
         [](compiler_state& state, clauf::declarator* child, postfix_declarator,
            clauf::parameter_list params) {
+            // The length of a native buffer has to be another integer parameter.
+            for (auto buffer : params)
+            {
+                auto length_symbol = buffer->native_buffer_length();
+                if (!length_symbol)
+                    continue;
+
+                auto found = false;
+                for (auto length : params)
+                    if (length->name() == length_symbol && clauf::is_integer(length->type()))
+                        found = true;
+
+                if (!found)
+                {
+                    state.logger
+                        .log(clauf::diagnostic_kind::error,
+                             "native buffer length '%s' is not an integer parameter",
+                             length_symbol.c_str(state.ast.symbols))
+                        .annotation(clauf::annotation_kind::primary,
+                                    state.ast.input.location_of(buffer), "used here")
+                        .finish();
+                }
+            }
+
             return state.decl_tree.create<clauf::function_declarator>(child, params);
         },
         [](compiler_state&                                          state, pointer_declarator,
@@ -1958,7 +2376,8 @@ struct member_decl
                   throw fatal_error();
               }
 
-              if (!ty_spec.is_valid_for_parameter_or_member())
+              if (!ty_spec.is_valid_for_parameter_or_member()
+                  || ty_spec.native == clauf::native_specifier::buffer)
               {
                   state.logger
                       .log(clauf::diagnostic_kind::error,
@@ -2003,12 +2422,12 @@ struct struct_specifier
               [](compiler_state& state, clauf::name name, clauf::member_list members) {
                   {
                       scope s(scope::struct_, state.current_scope);
-                      state.current_scope = &s;
+                      state.enter_scope(s);
 
                       for (auto mem : members)
                           insert_new_decl(state, mem);
 
-                      state.current_scope = s.parent;
+                      state.leave_scope();
                   }
 
                   auto result = state.ast.create<clauf::struct_decl>(name.loc, name.symbol,
@@ -2067,6 +2486,23 @@ struct parameter_decl
                       .finish();
               }
 
+              if (ty_spec.native == clauf::native_specifier::buffer)
+              {
+                  if (!clauf::is_pointer(type))
+                  {
+                      state.logger
+                          .log(clauf::diagnostic_kind::error,
+                               "native buffer specifier requires a pointer parameter")
+                          .annotation(clauf::annotation_kind::primary, name.loc,
+                                      "used to declare parameter here")
+                          .finish();
+                  }
+
+                  return state.ast.create<clauf::parameter_decl>(name.loc, name.symbol, type,
+                                                                 ty_spec.native_buffer_length
+                                                                     ->symbol);
+              }
+
               return state.ast.create<clauf::parameter_decl>(name.loc, name.symbol, type);
           });
 };
@@ -2259,6 +2695,15 @@ struct declaration
 
             throw fatal_error();
         }
+        if (ty_spec.native == clauf::native_specifier::buffer
+            && !dryad::node_has_kind<clauf::function_declarator>(declarator))
+        {
+            state.logger
+                .log(clauf::diagnostic_kind::error,
+                     "native buffer specifier can only be used on parameters and functions")
+                .annotation(clauf::annotation_kind::primary, name.loc, "here")
+                .finish();
+        }
 
         if (auto array = dryad::node_try_cast<clauf::array_type>(type);
             array != nullptr && array->is_incomplete() && initializer_count > 0)
@@ -2348,12 +2793,50 @@ struct declaration
                             .finish();
                     }
 
+                    clauf::ast_symbol native_buffer_length;
+                    if (ty_spec.native == clauf::native_specifier::buffer)
+                    {
+                        auto fn_type = dryad::node_cast<clauf::function_type>(type);
+                        if (!clauf::is_pointer(fn_type->return_type()))
+                        {
+                            state.logger
+                                .log(clauf::diagnostic_kind::error,
+                                     "native buffer specifier requires a pointer return type")
+                                .annotation(clauf::annotation_kind::primary, name.loc, "here")
+                                .finish();
+                        }
+
+                        // The length of the returned buffer is written into a native pointer to
+                        // an integer.
+                        native_buffer_length = ty_spec.native_buffer_length->symbol;
+                        auto found           = false;
+                        for (auto param : decl->parameters())
+                            if (auto ptr = dryad::node_try_cast<clauf::pointer_type>(param->type());
+                                param->name() == native_buffer_length && ptr != nullptr
+                                && ptr->native() == clauf::native_specifier::default_
+                                && clauf::is_integer(ptr->pointee_type()))
+                                found = true;
+
+                        if (!found)
+                        {
+                            state.logger
+                                .log(clauf::diagnostic_kind::error,
+                                     "native buffer length '%s' is not a native pointer to an "
+                                     "integer parameter",
+                                     native_buffer_length.c_str(state.ast.symbols))
+                                .annotation(clauf::annotation_kind::primary,
+                                            ty_spec.native_buffer_length->loc, "here")
+                                .finish();
+                        }
+                    }
+
                     // This is never a definition, since we don't have a function body.
                     return state.ast.create<clauf::function_decl>(name.loc,
                                                                   ty_spec.linkage.value_or(
                                                                       default_linkage),
                                                                   name.symbol, type,
-                                                                  decl->parameters());
+                                                                  decl->parameters(),
+                                                                  native_buffer_length);
                 });
         }
     }
@@ -2511,7 +2994,7 @@ struct global_declaration : lexy::scan_production<clauf::decl_list>
 
             state.current_function = fn_decl;
             scope local_scope(scope::local, state.current_scope);
-            state.current_scope = &local_scope;
+            state.enter_scope(local_scope);
             for (auto param : fn_decl->parameters())
             {
                 insert_new_decl(state, param);
@@ -2525,7 +3008,7 @@ struct global_declaration : lexy::scan_production<clauf::decl_list>
 
             codegen_new_decl(state, fn_decl);
 
-            state.current_scope    = state.current_scope->parent;
+            state.leave_scope();
             state.current_function = nullptr;
             return fn_decl->is_linked_in_tree() ? nullptr : fn_decl;
         }
@@ -2567,93 +3050,273 @@ struct translation_unit
 
 namespace
 {
-bool resolve_forward_declarations(compiler_state& state)
+// The pairs of structs that are assumed to be the same while their members are compared, which
+// ends the recursion for structs that refer to themselves.
+using struct_pairs = std::vector<std::pair<const clauf::struct_decl*, const clauf::struct_decl*>>;
+
+// Whether two types are the same, where rhs might be from a different translation unit.
+// Structs are then compared by their tag and members, as each translation unit has its own
+// declarations and symbols.
+bool is_same_type(const clauf::ast& lhs_ast, const clauf::type* lhs, const clauf::ast& rhs_ast,
+                  const clauf::type* rhs, struct_pairs& assumed)
+{
+    if (&lhs_ast == &rhs_ast)
+        return clauf::is_same(lhs, rhs);
+    if (lhs->kind() != rhs->kind())
+        return false;
+
+    auto same = [&](const clauf::type* lhs_child, const clauf::type* rhs_child) {
+        return is_same_type(lhs_ast, lhs_child, rhs_ast, rhs_child, assumed);
+    };
+    switch (lhs->kind())
+    {
+    case clauf::type_node_kind::builtin_type:
+        return dryad::node_cast<clauf::builtin_type>(lhs)->type_kind()
+               == dryad::node_cast<clauf::builtin_type>(rhs)->type_kind();
+    case clauf::type_node_kind::pointer_type: {
+        auto lhs_ptr = dryad::node_cast<clauf::pointer_type>(lhs);
+        auto rhs_ptr = dryad::node_cast<clauf::pointer_type>(rhs);
+        return lhs_ptr->native() == rhs_ptr->native()
+               && same(lhs_ptr->pointee_type(), rhs_ptr->pointee_type());
+    }
+    case clauf::type_node_kind::array_type: {
+        auto lhs_array = dryad::node_cast<clauf::array_type>(lhs);
+        auto rhs_array = dryad::node_cast<clauf::array_type>(rhs);
+        return lhs_array->size() == rhs_array->size()
+               && same(lhs_array->element_type(), rhs_array->element_type());
+    }
+    case clauf::type_node_kind::function_type: {
+        auto lhs_fn = dryad::node_cast<clauf::function_type>(lhs);
+        auto rhs_fn = dryad::node_cast<clauf::function_type>(rhs);
+        if (!same(lhs_fn->return_type(), rhs_fn->return_type()))
+            return false;
+
+        auto lhs_params = lhs_fn->parameters();
+        auto rhs_params = rhs_fn->parameters();
+        auto lhs_iter   = lhs_params.begin();
+        auto rhs_iter   = rhs_params.begin();
+        for (; lhs_iter != lhs_params.end() && rhs_iter != rhs_params.end(); ++lhs_iter, ++rhs_iter)
+            if (!same(*lhs_iter, *rhs_iter))
+                return false;
+        return lhs_iter == lhs_params.end() && rhs_iter == rhs_params.end();
+    }
+    case clauf::type_node_kind::qualified_type: {
+        auto lhs_qual = dryad::node_cast<clauf::qualified_type>(lhs);
+        auto rhs_qual = dryad::node_cast<clauf::qualified_type>(rhs);
+        return lhs_qual->qualifiers() == rhs_qual->qualifiers()
+               && same(lhs_qual->unqualified_type(), rhs_qual->unqualified_type());
+    }
+    case clauf::type_node_kind::decl_type: {
+        auto lhs_decl = dryad::node_cast<clauf::struct_decl>(
+            dryad::node_cast<clauf::decl_type>(lhs)->decl());
+        auto rhs_decl = dryad::node_cast<clauf::struct_decl>(
+            dryad::node_cast<clauf::decl_type>(rhs)->decl());
+        if (std::strcmp(lhs_decl->name().c_str(lhs_ast.symbols),
+                        rhs_decl->name().c_str(rhs_ast.symbols))
+            != 0)
+            return false;
+
+        auto lhs_def = lhs_decl->definition();
+        auto rhs_def = rhs_decl->definition();
+        if (lhs_def == nullptr || rhs_def == nullptr)
+            // An incomplete struct is the same as any struct with its tag.
+            return true;
+        if (std::find(assumed.begin(), assumed.end(), std::make_pair(lhs_def, rhs_def))
+            != assumed.end())
+            return true;
+
+        assumed.emplace_back(lhs_def, rhs_def);
+        auto lhs_members = lhs_def->members();
+        auto rhs_members = rhs_def->members();
+        auto lhs_iter    = lhs_members.begin();
+        auto rhs_iter    = rhs_members.begin();
+        for (; lhs_iter != lhs_members.end() && rhs_iter != rhs_members.end();
+             ++lhs_iter, ++rhs_iter)
+            if (std::strcmp((*lhs_iter)->name().c_str(lhs_ast.symbols),
+                            (*rhs_iter)->name().c_str(rhs_ast.symbols))
+                    != 0
+                || !same((*lhs_iter)->type(), (*rhs_iter)->type()))
+                break;
+        auto result = lhs_iter == lhs_members.end() && rhs_iter == rhs_members.end();
+        assumed.pop_back();
+        return result;
+    }
+    }
+    return false;
+}
+
+bool is_same_type(const clauf::ast& lhs_ast, const clauf::type* lhs, const clauf::ast& rhs_ast,
+                  const clauf::type* rhs)
+{
+    struct_pairs assumed;
+    return is_same_type(lhs_ast, lhs, rhs_ast, rhs, assumed);
+}
+
+// Logs that a forward declaration doesn't match its definition in def_unit.
+void log_mismatched_definition(compiler_state& unit, clauf::decl* decl, compiler_state& def_unit,
+                               clauf::decl* def, const char* problem)
+{
+    auto name = decl->name().c_str(unit.ast.symbols);
+    if (&def_unit == &unit)
+    {
+        unit.logger.log(clauf::diagnostic_kind::error, "redeclaration of '%s' %s", name, problem)
+            .annotation(clauf::annotation_kind::secondary, unit.ast.input.location_of(def),
+                        "definition")
+            .annotation(clauf::annotation_kind::primary, unit.ast.input.location_of(decl),
+                        "forward declaration")
+            .finish();
+    }
+    else
+    {
+        // We can only annotate the file of the translation unit.
+        unit.logger
+            .log(clauf::diagnostic_kind::error, "redeclaration of '%s' %s, defined in '%s'", name,
+                 problem, def_unit.ast.input.path())
+            .annotation(clauf::annotation_kind::primary, unit.ast.input.location_of(decl),
+                        "forward declaration")
+            .finish();
+    }
+}
+
+// Links the extern declarations of all translation units to their definitions.
+bool resolve_forward_declarations(std::vector<std::unique_ptr<compiler_state>>& units)
 {
     auto success = true;
 
     // Collect all definitions of extern declarations in a map.
-    dryad::symbol_table<clauf::ast_symbol, clauf::decl*> extern_definitions;
-    dryad::visit_tree(state.ast.tree, [&](clauf::decl* decl) {
-        if (decl->has_definition() && decl->linkage() == clauf::linkage::external)
-            // Note: this can't shadow in a well-formed program, as we checked for duplicate
-            // definition.
-            extern_definitions.insert_or_shadow(decl->name(), decl);
-    });
+    // It is keyed by the name, as the translation units don't share symbols.
+    struct definition
+    {
+        clauf::decl*    decl;
+        compiler_state* unit;
+    };
+    std::unordered_map<std::string_view, definition> extern_definitions;
+    // Every translation unit can define the same struct, so they are kept separately.
+    std::unordered_multimap<std::string_view, definition> struct_definitions;
+    for (auto& unit : units)
+        dryad::visit_tree(unit->ast.tree, [&](clauf::decl* decl) {
+            if (!decl->is_definition() || decl->linkage() != clauf::linkage::external)
+                return;
 
-    // Resolve all declarations of extern symbols.
-    dryad::visit_tree(state.ast.tree, [&](clauf::decl* decl) {
-        if (!decl->has_definition() && decl->linkage() == clauf::linkage::external)
+            auto name = decl->name().c_str(unit->ast.symbols);
+            if (dryad::node_has_kind<clauf::struct_decl>(decl))
+            {
+                struct_definitions.emplace(name, definition{decl, unit.get()});
+                return;
+            }
+
+            // Note: this can only be a duplicate from a different translation unit, as we checked
+            // for duplicate definitions inside of one.
+            auto [iter, inserted] = extern_definitions.emplace(name, definition{decl, unit.get()});
+            if (!inserted)
+            {
+                unit->logger
+                    .log(clauf::diagnostic_kind::error,
+                         "duplicate definition of '%s', first defined in '%s'", name,
+                         iter->second.unit->ast.input.path())
+                    .annotation(clauf::annotation_kind::primary,
+                                unit->ast.input.location_of(decl), "second definition")
+                    .finish();
+                success = false;
+            }
+        });
+
+    auto find_definition = [&](compiler_state* unit, clauf::decl* decl) -> const definition* {
+        auto name = decl->name().c_str(unit->ast.symbols);
+        if (!dryad::node_has_kind<clauf::struct_decl>(decl))
         {
-            auto def = extern_definitions.lookup(decl->name());
-            if (def == nullptr)
+            auto iter = extern_definitions.find(name);
+            return iter == extern_definitions.end() ? nullptr : &iter->second;
+        }
+
+        // A struct is defined by its own translation unit, unless it is only declared there and
+        // its definition is private to another one.
+        const definition* result = nullptr;
+        for (auto [iter, end] = struct_definitions.equal_range(name); iter != end; ++iter)
+            if (result == nullptr || iter->second.unit == unit)
+                result = &iter->second;
+        return result;
+    };
+
+    // Resolve all declarations of extern symbols.
+    for (auto& unit : units)
+        dryad::visit_tree(unit->ast.tree, [&](clauf::decl* decl) {
+            if (decl->has_definition() || decl->linkage() != clauf::linkage::external)
+                return;
+
+            auto name  = decl->name().c_str(unit->ast.symbols);
+            auto found = find_definition(unit.get(), decl);
+            if (found == nullptr)
             {
-                auto name = decl->name().c_str(state.ast.symbols);
-                state.logger
+                unit->logger
                     .log(clauf::diagnostic_kind::error, "undefined declaration of '%s'", name)
-                    .annotation(clauf::annotation_kind::primary, state.ast.input.location_of(decl),
-                                "forward declaration here")
+                    .annotation(clauf::annotation_kind::primary,
+                                unit->ast.input.location_of(decl), "forward declaration here")
                     .finish();
                 success = false;
                 return;
             }
 
+            auto [def, def_unit] = *found;
             if (decl->kind() != def->kind())
             {
-                auto name = decl->name().c_str(state.ast.symbols);
-                state.logger
-                    .log(clauf::diagnostic_kind::error,
-                         "redeclaration of '%s' as a different entity", name)
-                    .annotation(clauf::annotation_kind::secondary, state.ast.input.location_of(def),
-                                "definition")
-                    .annotation(clauf::annotation_kind::primary, state.ast.input.location_of(decl),
-                                "forward declaration")
-                    .finish();
+                log_mismatched_definition(*unit, decl, *def_unit, def, "as a different entity");
                 success = false;
             }
-            else if (!clauf::is_same(decl->type(), def->type()))
+            else if (!is_same_type(unit->ast, decl->type(), def_unit->ast, def->type()))
             {
-                auto name = decl->name().c_str(state.ast.symbols);
-                state.logger
-                    .log(clauf::diagnostic_kind::error,
-                         "redeclaration of '%s' with a different type", name)
-                    .annotation(clauf::annotation_kind::secondary, state.ast.input.location_of(def),
-                                "definition")
-                    .annotation(clauf::annotation_kind::primary, state.ast.input.location_of(decl),
-                                "forward declaration")
-                    .finish();
+                log_mismatched_definition(*unit, decl, *def_unit, def, "with a different type");
                 success = false;
             }
             else
             {
                 decl->set_definition(def);
             }
-        }
-    });
+        });
 
     return success;
 }
 } // namespace
 
-std::optional<clauf::compilation_result> clauf::compile(lauf_vm* vm, file&& input)
+std::optional<clauf::compilation_result> clauf::compile(lauf_vm*                vm,
+                                                        const native_libraries& libraries,
+                                                        std::vector<file>&&     inputs)
 try
 {
-    compiler_state state(vm, LEXY_MOV(input));
-
-    auto result = lexy::parse<clauf::grammar::translation_unit>(state.ast.input.buffer(), state,
-                                                                state.logger.error_callback());
-    if (!result || !state.logger)
-        return std::nullopt;
+    clauf::codegen codegen(vm, libraries);
 
-    state.ast.tree.set_root(result.value());
-    state.ast.tree.root()->add_structs(state.structs);
+    std::vector<std::unique_ptr<compiler_state>> units;
+    for (auto& input : inputs)
+    {
+        auto& state
+            = *units.emplace_back(std::make_unique<compiler_state>(codegen, LEXY_MOV(input)));
+        if (units.size() > 1)
+            // Generated names continue the previous unit's, so they are unique in the module.
+            state.symbol_generator_count = units[units.size() - 2]->symbol_generator_count;
+
+        auto result = lexy::parse<clauf::grammar::translation_unit>(state.ast.input.buffer(),
+                                                                    state,
+                                                                    state.logger.error_callback());
+        if (!result || !state.logger)
+            return std::nullopt;
+
+        state.ast.tree.set_root(result.value());
+        state.ast.tree.root()->add_structs(state.structs);
+    }
 
-    if (!resolve_forward_declarations(state))
+    if (!resolve_forward_declarations(units))
         return std::nullopt;
 
-    auto code = std::move(state.codegen).finish(state.ast);
-    if (!code)
-        return std::nullopt;
-    return clauf::compilation_result{std::move(state.ast), std::move(code.value())};
+    // Only now can we generate the definitions, as they can refer to other translation units.
+    for (auto& unit : units)
+        if (!codegen.define(unit->logger, unit->ast))
+            return std::nullopt;
+
+    clauf::compilation_result result{{}, std::move(codegen).finish()};
+    result.asts.reserve(units.size());
+    for (auto& unit : units)
+        result.asts.push_back(std::move(unit->ast));
+    return result;
 }
 catch (fatal_error)
 {
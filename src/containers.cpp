@@ -0,0 +1,205 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#include <clauf/containers.hpp>
+
+#include <functional>
+#include <utility>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#endif
+
+namespace
+{
+constexpr auto group_width  = std::size_t(16);
+constexpr auto min_capacity = group_width;
+constexpr auto npos         = std::size_t(-1);
+
+// A control byte is either empty, deleted, or the low seven bits of the hash of a full slot.
+constexpr auto control_empty   = std::uint8_t(0x80);
+constexpr auto control_deleted = std::uint8_t(0xFE);
+
+std::uint64_t mix(std::uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+std::uint64_t hash_key(std::uint64_t key)
+{
+    return mix(key);
+}
+std::uint64_t hash_key(std::string_view key)
+{
+    return mix(std::hash<std::string_view>{}(key));
+}
+
+std::uint8_t hash_control(std::uint64_t hash)
+{
+    return std::uint8_t(hash & 0x7F);
+}
+
+// Returns a bit mask of the control bytes in the group that are equal to value.
+std::uint32_t match_group(const std::uint8_t* group, std::uint8_t value)
+{
+#if defined(__SSE2__)
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    auto cmp   = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(value)));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(cmp));
+#else
+    auto result = std::uint32_t(0);
+    for (auto i = 0u; i != group_width; ++i)
+        if (group[i] == value)
+            result |= 1u << i;
+    return result;
+#endif
+}
+
+// Returns a bit mask of the control bytes in the group that are empty or deleted.
+std::uint32_t match_group_free(const std::uint8_t* group)
+{
+#if defined(__SSE2__)
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(bytes));
+#else
+    auto result = std::uint32_t(0);
+    for (auto i = 0u; i != group_width; ++i)
+        if ((group[i] & 0x80) != 0)
+            result |= 1u << i;
+    return result;
+#endif
+}
+
+std::size_t first_match(std::uint32_t mask)
+{
+    return std::size_t(__builtin_ctz(mask));
+}
+} // namespace
+
+template <typename Key, typename Lookup>
+const std::uint64_t* clauf::hash_map::table<Key, Lookup>::find(const Lookup& key) const
+{
+    auto idx = find_index(key, hash_key(key));
+    return idx == npos ? nullptr : &_slots[idx].value;
+}
+
+template <typename Key, typename Lookup>
+bool clauf::hash_map::table<Key, Lookup>::insert(Key key, std::uint64_t value)
+{
+    auto hash = hash_key(Lookup(key));
+    if (auto idx = find_index(key, hash); idx != npos)
+    {
+        _slots[idx].value = value;
+        return false;
+    }
+
+    // We keep at least an eighth of the slots empty, so probing always terminates.
+    if ((_size + _deleted + 1) * 8 > _slots.size() * 7)
+    {
+        // If the table is mostly tombstones, rehashing in place is enough.
+        auto capacity = _slots.size() < min_capacity ? min_capacity : _slots.size();
+        if ((_size + 1) * 2 > capacity)
+            capacity *= 2;
+        rehash(capacity);
+    }
+
+    auto idx = find_free(hash);
+    if (_control[idx] == control_deleted)
+        --_deleted;
+    set_control(idx, hash_control(hash));
+    _slots[idx].key   = std::move(key);
+    _slots[idx].value = value;
+    ++_size;
+    return true;
+}
+
+template <typename Key, typename Lookup>
+bool clauf::hash_map::table<Key, Lookup>::erase(const Lookup& key)
+{
+    auto idx = find_index(key, hash_key(key));
+    if (idx == npos)
+        return false;
+
+    set_control(idx, control_deleted);
+    _slots[idx].key = Key();
+    --_size;
+    ++_deleted;
+    return true;
+}
+
+template <typename Key, typename Lookup>
+std::size_t clauf::hash_map::table<Key, Lookup>::find_index(const Lookup&  key,
+                                                            std::uint64_t hash) const
+{
+    auto capacity = _slots.size();
+    if (capacity == 0)
+        return npos;
+
+    auto mask    = capacity - 1;
+    auto control = hash_control(hash);
+    for (auto pos = (hash >> 7) & mask, probed = std::size_t(0); probed < capacity;
+         pos = (pos + group_width) & mask, probed += group_width)
+    {
+        auto group = _control.data() + pos;
+        for (auto matches = match_group(group, control); matches != 0; matches &= matches - 1)
+        {
+            auto idx = (pos + first_match(matches)) & mask;
+            if (Lookup(_slots[idx].key) == key)
+                return idx;
+        }
+
+        if (match_group(group, control_empty) != 0)
+            return npos;
+    }
+    return npos;
+}
+
+template <typename Key, typename Lookup>
+std::size_t clauf::hash_map::table<Key, Lookup>::find_free(std::uint64_t hash) const
+{
+    auto mask = _slots.size() - 1;
+    for (auto pos = (hash >> 7) & mask;; pos = (pos + group_width) & mask)
+    {
+        if (auto matches = match_group_free(_control.data() + pos); matches != 0)
+            return (pos + first_match(matches)) & mask;
+    }
+}
+
+template <typename Key, typename Lookup>
+void clauf::hash_map::table<Key, Lookup>::set_control(std::size_t idx, std::uint8_t value)
+{
+    _control[idx] = value;
+    if (idx < group_width)
+        _control[_slots.size() + idx] = value;
+}
+
+template <typename Key, typename Lookup>
+void clauf::hash_map::table<Key, Lookup>::rehash(std::size_t capacity)
+{
+    auto old_control = std::move(_control);
+    auto old_slots   = std::move(_slots);
+
+    _control.assign(capacity + group_width, control_empty);
+    _slots.clear();
+    _slots.resize(capacity);
+    _deleted = 0;
+
+    for (auto i = std::size_t(0); i != old_slots.size(); ++i)
+    {
+        if ((old_control[i] & 0x80) != 0)
+            continue;
+
+        auto idx = find_free(hash_key(Lookup(old_slots[i].key)));
+        set_control(idx, old_control[i]);
+        _slots[idx] = std::move(old_slots[i]);
+    }
+}
+
+template class clauf::hash_map::table<std::uint64_t, std::uint64_t>;
+template class clauf::hash_map::table<std::string, std::string_view>;
+
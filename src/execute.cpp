@@ -0,0 +1,46 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#include <clauf/execute.hpp>
+
+#include <cstdio>
+#include <lauf/runtime/value.h>
+#include <lauf/vm.h>
+
+#include <clauf/allocator.hpp>
+#include <clauf/codegen.hpp>
+
+const lauf_asm_function* clauf::find_main(lauf_asm_module* mod)
+{
+    auto main_fn = lauf_asm_find_function_by_name(mod, "main");
+    if (main_fn == nullptr)
+    {
+        std::fprintf(stderr, "Program does not contain main.\n");
+        return nullptr;
+    }
+    if (auto sig = lauf_asm_function_signature(main_fn);
+        sig.input_count != 0 || sig.output_count != 1)
+    {
+        std::fprintf(stderr, "main signature is wrong: (%d => %d)\n", sig.input_count,
+                     sig.output_count);
+        return nullptr;
+    }
+
+    return main_fn;
+}
+
+std::optional<int> clauf::executable::execute()
+{
+    // A new process might re-use the address of the previous one, so the builtins can't detect
+    // that their state is stale.
+    reset_builtin_state();
+
+    lauf_runtime_value return_code;
+    auto               success = lauf_vm_execute(_vm, _program, nullptr, &return_code);
+    // The process is gone, so is everything it has allocated.
+    heap::release();
+
+    if (!success)
+        return std::nullopt;
+    return static_cast<int>(return_code.as_sint);
+}
@@ -0,0 +1,274 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#include <clauf/io.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+// Like read() and write(), a single request transfers at most that many bytes.
+constexpr auto max_transfer = std::size_t(0x7ffff000);
+
+// We use the system calls directly instead of depending on liburing.
+int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+    return int(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return int(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+void execute_sync(clauf::io_request& request)
+{
+    auto length = std::min(request.length, max_transfer);
+    auto result = request.is_write
+                      ? pwrite(request.fd, request.buffer, length, off_t(request.offset))
+                      : pread(request.fd, request.buffer, length, off_t(request.offset));
+    request.result = result < 0 ? -errno : std::int64_t(result);
+}
+
+class io_ring
+{
+public:
+    static constexpr auto entries = 256u;
+
+    io_ring()
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        _fd = io_uring_setup(entries, &params);
+        if (_fd < 0)
+            return;
+
+        _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+            _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+
+        _sq_ring = map(_sq_size, IORING_OFF_SQ_RING);
+        _cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) != 0
+                       ? _sq_ring
+                       : map(_cq_size, IORING_OFF_CQ_RING);
+        _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        _sqes      = static_cast<io_uring_sqe*>(map(_sqes_size, IORING_OFF_SQES));
+        if (_sq_ring == nullptr || _cq_ring == nullptr || _sqes == nullptr)
+        {
+            destroy();
+            return;
+        }
+
+        auto sq    = static_cast<char*>(_sq_ring);
+        _sq_head   = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        _sq_tail   = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        _sq_mask   = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        _sq_array  = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        _sq_length = params.sq_entries;
+
+        auto cq  = static_cast<char*>(_cq_ring);
+        _cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        _cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        _cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        _cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    io_ring(const io_ring&)            = delete;
+    io_ring& operator=(const io_ring&) = delete;
+
+    ~io_ring()
+    {
+        destroy();
+    }
+
+    bool is_available() const
+    {
+        return _fd >= 0 && !_failed;
+    }
+
+    // Submits the requests and waits for their completion.
+    // If the ring fails, the requests that haven't run are executed synchronously and the ring isn't
+    // used anymore.
+    void execute(clauf::io_request* requests, unsigned count)
+    {
+        auto first = *_sq_tail;
+        auto tail  = first;
+        for (auto i = 0u; i != count; ++i)
+        {
+            auto idx = tail & _sq_mask;
+            auto sqe = &_sqes[idx];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode    = requests[i].is_write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd        = requests[i].fd;
+            sqe->addr      = reinterpret_cast<std::uintptr_t>(requests[i].buffer);
+            sqe->len       = unsigned(std::min(requests[i].length, max_transfer));
+            sqe->off       = requests[i].offset;
+            sqe->user_data = i;
+            _sq_array[idx] = idx;
+            ++tail;
+        }
+        __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+
+        std::vector<bool> is_completed(count, false);
+        auto              submitted = 0u;
+        auto              completed = 0u;
+        while (completed != count)
+        {
+            auto result = io_uring_enter(_fd, count - submitted, count - completed,
+                                         IORING_ENTER_GETEVENTS);
+            if (result < 0 && errno != EINTR)
+            {
+                // Any other error won't go away by trying again.
+                fail(requests, first, is_completed);
+                return;
+            }
+            if (result > 0)
+                submitted += unsigned(result);
+
+            completed += harvest(requests, is_completed);
+        }
+    }
+
+    unsigned max_batch_size() const
+    {
+        return _sq_length;
+    }
+
+private:
+    // The user data of the entries that cancel a request, whose completions are ignored.
+    static constexpr auto cancel_tag = ~std::uint64_t(0);
+
+    // Stores the result of the completed requests; returns their number.
+    unsigned harvest(clauf::io_request* requests, std::vector<bool>& is_completed)
+    {
+        auto completed = 0u;
+        auto head      = *_cq_head;
+        for (auto cq_tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE); head != cq_tail; ++head)
+        {
+            auto& cqe = _cqes[head & _cq_mask];
+            if (cqe.user_data == cancel_tag)
+                continue;
+
+            requests[cqe.user_data].result = cqe.res;
+            is_completed[cqe.user_data]    = true;
+            ++completed;
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+        return completed;
+    }
+
+    // first is the tail of the submission queue before the requests were added.
+    void fail(clauf::io_request* requests, unsigned first, std::vector<bool>& is_completed)
+    {
+        // Take back the entries the kernel hasn't consumed yet; those requests were never submitted.
+        auto head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        __atomic_store_n(_sq_tail, head, __ATOMIC_RELEASE);
+        auto submitted = head - first;
+        harvest(requests, is_completed);
+
+        // The kernel still executes the requests it has consumed and accesses their buffers, so we
+        // must not return before they have completed. Cancel them, so we don't wait for long.
+        auto tail = head;
+        for (auto i = 0u; i != submitted; ++i)
+            if (!is_completed[i])
+            {
+                auto sqe = &_sqes[tail & _sq_mask];
+                std::memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode                = IORING_OP_ASYNC_CANCEL;
+                sqe->fd                    = -1;
+                sqe->addr                  = i;
+                sqe->user_data             = cancel_tag;
+                _sq_array[tail & _sq_mask] = tail & _sq_mask;
+                ++tail;
+            }
+        __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+        // If this fails as well, the requests complete on their own.
+        io_uring_enter(_fd, tail - head, 0, 0);
+
+        auto pending = unsigned(std::count(is_completed.begin(),
+                                           is_completed.begin() + std::ptrdiff_t(submitted), false));
+        while (pending > 0)
+        {
+            if (io_uring_enter(_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                // We can't wait for completions, so we have to poll.
+                usleep(100);
+            pending -= harvest(requests, is_completed);
+        }
+
+        // A request that was cancelled before it ran is executed again, like the ones that were
+        // never submitted.
+        for (auto i = 0u; i != is_completed.size(); ++i)
+            if (i >= submitted || requests[i].result == -ECANCELED)
+                execute_sync(requests[i]);
+
+        // Completions of the cancellations must not be confused with ones of later batches.
+        _failed = true;
+    }
+
+    void* map(std::size_t size, off_t offset)
+    {
+        auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd,
+                        offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    void destroy()
+    {
+        if (_sqes != nullptr)
+            munmap(_sqes, _sqes_size);
+        if (_cq_ring != nullptr && _cq_ring != _sq_ring)
+            munmap(_cq_ring, _cq_size);
+        if (_sq_ring != nullptr)
+            munmap(_sq_ring, _sq_size);
+        if (_fd >= 0)
+            close(_fd);
+        _fd = -1;
+    }
+
+    int  _fd     = -1;
+    bool _failed = false;
+
+    void*         _sq_ring   = nullptr;
+    std::size_t   _sq_size   = 0;
+    unsigned*     _sq_head   = nullptr;
+    unsigned*     _sq_tail   = nullptr;
+    unsigned      _sq_mask   = 0;
+    unsigned*     _sq_array  = nullptr;
+    unsigned      _sq_length = 0;
+    io_uring_sqe* _sqes      = nullptr;
+    std::size_t   _sqes_size = 0;
+
+    void*         _cq_ring = nullptr;
+    std::size_t   _cq_size = 0;
+    unsigned*     _cq_head = nullptr;
+    unsigned*     _cq_tail = nullptr;
+    unsigned      _cq_mask = 0;
+    io_uring_cqe* _cqes    = nullptr;
+};
+} // namespace
+
+void clauf::execute_io(std::vector<io_request>& requests)
+{
+    static io_ring ring;
+
+    auto cur = requests.data();
+    auto end = requests.data() + requests.size();
+    while (cur != end && ring.is_available())
+    {
+        auto count
+            = unsigned(std::min(std::size_t(end - cur), std::size_t(ring.max_batch_size())));
+        ring.execute(cur, count);
+        cur += count;
+    }
+
+    // If the ring isn't available, the requests are executed synchronously.
+    for (; cur != end; ++cur)
+        execute_sync(*cur);
+}
@@ -0,0 +1,131 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#include <clauf/line_index.hpp>
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+#if defined(__AVX2__)
+constexpr auto block_size = std::size_t(32);
+
+// Returns a bit mask of the bytes in the block that are newlines.
+std::uint32_t match_newlines(const char* block)
+{
+    auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    auto cmp   = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(cmp));
+}
+#elif defined(__SSE2__)
+constexpr auto block_size = std::size_t(16);
+
+std::uint32_t match_newlines(const char* block)
+{
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+    auto cmp   = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(cmp));
+}
+#else
+constexpr auto block_size = std::size_t(8);
+
+std::uint32_t match_newlines(const char* block)
+{
+    auto result = std::uint32_t(0);
+    for (auto i = 0u; i != block_size; ++i)
+        if (block[i] == '\n')
+            result |= 1u << i;
+    return result;
+}
+#endif
+} // namespace
+
+clauf::line_index::line_index(const char* begin, std::size_t size) : _begin(begin)
+{
+    // Source files average about 30 bytes per line.
+    _line_begins.reserve(size / 32 + 1);
+    _line_begins.push_back(0);
+
+    auto offset = std::size_t(0);
+    for (; offset + block_size <= size; offset += block_size)
+        for (auto matches = match_newlines(begin + offset); matches != 0; matches &= matches - 1)
+        {
+            auto newline = offset + std::size_t(__builtin_ctz(matches));
+            _line_begins.push_back(std::uint32_t(newline + 1));
+        }
+
+    for (; offset != size; ++offset)
+        if (begin[offset] == '\n')
+            _line_begins.push_back(std::uint32_t(offset + 1));
+}
+
+clauf::line_index::position clauf::line_index::lookup(const char* ptr) const
+{
+    auto offset = std::uint32_t(ptr - _begin);
+    // The line is the last one that begins at or before the offset.
+    auto line = std::upper_bound(_line_begins.begin(), _line_begins.end(), offset) - 1;
+
+    // Count the code points before the position, i.e. all bytes that aren't continuation bytes.
+    auto column = 1u;
+    for (auto cur = _begin + *line; cur != ptr; ++cur)
+        if ((static_cast<unsigned char>(*cur) & 0xC0) != 0x80)
+            ++column;
+
+    return {unsigned(line - _line_begins.begin()) + 1, column};
+}
+
+const char* clauf::line_map::source::find(unsigned line_nr, unsigned column_nr) const
+{
+    auto cur = data;
+    auto end = data + size;
+    for (auto line = 1u; line != line_nr && cur != end; ++cur)
+        if (*cur == '\n')
+            ++line;
+
+    for (auto column = 1u; cur != end && *cur != '\n'; ++cur)
+        if ((static_cast<unsigned char>(*cur) & 0xC0) != 0x80 && column++ == column_nr)
+            break;
+    return cur;
+}
+
+unsigned clauf::line_map::add_source(std::string path, const char* data, std::size_t size)
+{
+    _sources.push_back({std::move(path), data, size});
+    return unsigned(_sources.size() - 1);
+}
+
+void clauf::line_map::add(unsigned output_line_nr, unsigned source, unsigned line_nr)
+{
+    if (!_segments.empty())
+    {
+        auto& last      = _segments.back();
+        auto  continued = last.line_nr + (output_line_nr - last.output_line_nr);
+        if (last.source == source && continued == line_nr)
+            // The lines continue the last segment.
+            return;
+        else if (last.output_line_nr == output_line_nr)
+        {
+            // The last segment has no lines, e.g. because it is an empty file.
+            last = {output_line_nr, source, line_nr};
+            return;
+        }
+    }
+
+    _segments.push_back({output_line_nr, source, line_nr});
+}
+
+clauf::line_map::position clauf::line_map::lookup(line_index::position pos) const
+{
+    // The segment is the last one that begins at or before the line.
+    auto iter = std::upper_bound(_segments.begin(), _segments.end(), pos.line_nr,
+                                 [](unsigned line_nr, const segment& s) {
+                                     return line_nr < s.output_line_nr;
+                                 })
+                - 1;
+    return {&_sources[iter->source], iter->line_nr + (pos.line_nr - iter->output_line_nr),
+            pos.column_nr};
+}
@@ -3,50 +3,106 @@
 
 #include <CLI11.hpp>
 #include <cstdio>
-#include <lexy/input/file.hpp>
+#include <lexy/input/buffer.hpp>
+#include <map>
 #include <string>
+#include <vector>
 
-#include <lauf/asm/program.h>
 #include <lauf/backend/dump.h>
-#include <lauf/runtime/value.h>
 #include <lauf/vm.h>
 #include <lauf/writer.h>
 
+#include <clauf/allocator.hpp>
 #include <clauf/assert.hpp>
 #include <clauf/ast.hpp>
 #include <clauf/codegen.hpp>
 #include <clauf/compiler.hpp>
+#include <clauf/diagnostic.hpp>
+#include <clauf/execute.hpp>
+#include <clauf/preprocessor.hpp>
 
 namespace clauf
 {
 struct options
 {
-    std::string input;
-    bool        compile_only  = false;
-    bool        dump_ast      = false;
-    bool        dump_bytecode = false;
+    std::vector<std::string> inputs;
+    std::vector<std::string> link;
+    std::vector<std::string> include_dirs;
+    bool                     compile_only  = false;
+    bool                     dump_ast      = false;
+    bool                     dump_bytecode = false;
+    bool                     mem_report    = false;
+    std::size_t              runs          = 1;
+    heap_allocator           allocator     = heap_allocator::pool;
 };
 
 int main(const options& opts)
 {
     auto exit_code = 0;
 
-    auto file = lexy::read_file<lexy::utf8_char_encoding>(opts.input.c_str());
-    if (!file)
+    // Headers shared by the translation units are only read once.
+    // The cache also keeps the text of the inputs, as diagnostics quote it.
+    include_cache     includes;
+    diagnostic_logger logger;
+    std::vector<file> inputs;
+    for (auto& input : opts.inputs)
     {
-        std::fprintf(stderr, "error: input file '%s' not found.\n", opts.input.c_str());
-        return 1;
+        auto entry = includes.load(input);
+        if (entry == nullptr)
+        {
+            std::fprintf(stderr, "error: input file '%s' not found.\n", input.c_str());
+            return 1;
+        }
+
+        auto source = preprocess(includes, opts.include_dirs, logger, input.c_str(), entry->data,
+                                 entry->size);
+        if (!source)
+            return 1;
+
+        inputs.emplace_back(input.c_str(),
+                            lexy::buffer<lexy::utf8_char_encoding>(source->text.data(),
+                                                                   source->text.size()),
+                            std::move(source->lines));
     }
 
-    auto vm     = lauf_create_vm(lauf_default_vm_options);
-    auto result = compile(vm, clauf::file(opts.input.c_str(), LEXY_MOV(file).buffer()));
+    clauf::native_libraries libraries;
+    for (auto& lib : opts.link)
+        if (auto error = libraries.add(lib.c_str()))
+        {
+            std::fprintf(stderr, "error: unable to load native library '%s': %s\n", lib.c_str(),
+                         error->c_str());
+            return 1;
+        }
+
+    heap::select(opts.allocator);
+    auto vm_options      = lauf_default_vm_options;
+    vm_options.allocator = heap::vm_allocator();
+
+    if (opts.mem_report)
+        enable_memory_report();
+
+    auto vm = lauf_create_vm(vm_options);
+    // The VM is destroyed on every return, and afterwards, the memory it allocated can be released.
+    struct vm_guard
+    {
+        lauf_vm* vm;
+
+        ~vm_guard()
+        {
+            lauf_destroy_vm(vm);
+            heap::release();
+        }
+    } guard{vm};
+
+    auto result = compile(vm, libraries, std::move(inputs));
     if (!result)
         return 1;
 
     if (opts.dump_ast)
     {
         std::puts("=== AST ===");
-        dump_ast(result->ast);
+        for (auto& ast : result->asts)
+            dump_ast(ast);
         std::putchar('\n');
     }
 
@@ -63,29 +119,29 @@ int main(const options& opts)
 
         if (!opts.compile_only)
         {
-            auto main_fn = lauf_asm_find_function_by_name(mod, "main");
+            auto main_fn = find_main(mod);
             if (main_fn == nullptr)
-            {
-                std::fprintf(stderr, "Program does not contain main.\n");
                 return 1;
-            }
-            if (auto sig = lauf_asm_function_signature(main_fn);
-                sig.input_count != 0 || sig.output_count != 1)
+
+            // Each run starts from the same initial state.
+            executable exe(vm, mod, main_fn);
+            auto failed = false;
+            for (auto run = std::size_t(0); run != opts.runs && !failed; ++run)
             {
-                std::fprintf(stderr, "main signature is wrong: (%d => %d)\n", sig.input_count,
-                             sig.output_count);
-                return 1;
+                auto result = exe.execute();
+                if (result)
+                    exit_code = *result;
+                else
+                    failed = true;
             }
 
-            auto program = lauf_asm_create_program(mod, main_fn);
-
-            lauf_runtime_value return_code;
-            if (!lauf_vm_execute_oneshot(vm, program, nullptr, &return_code))
+            // The report is also useful if the program panicked.
+            if (opts.mem_report)
+                print_memory_report();
+            if (failed)
                 return 1;
-            exit_code = static_cast<int>(return_code.as_sint);
         }
     }
-    lauf_destroy_vm(vm);
 
     // Exit code 70 is EX_SOFTWARE in sysexits.h
     return clauf::_detail::todo_reached ? 70 : exit_code;
@@ -97,11 +153,34 @@ int main(int argc, char* argv[])
     CLI::App       app("C interpreter");
     clauf::options options;
 
-    app.add_option("input", options.input, "The C file to be interpreted.")->required();
+    app.add_option("input", options.inputs,
+                   "The C files to be interpreted; each is a separate translation unit.")
+        ->required();
+    app.add_option("--link", options.link,
+                   "Native library to resolve native functions in; searched in the given order.");
+
+    app.add_option("-I,--include-dir", options.include_dirs,
+                   "Directory to search for included files; searched in the given order.");
+
+    app.add_option("--persistent", options.runs,
+                   "Execute main the given number of times, each starting from the initial state.")
+        ->check(CLI::PositiveNumber);
+
+    std::map<std::string, clauf::heap_allocator> allocators
+        = {{"pool", clauf::heap_allocator::pool},
+           {"malloc", clauf::heap_allocator::malloc},
+           {"arena", clauf::heap_allocator::arena},
+           {"hugepage", clauf::heap_allocator::hugepage}};
+    app.add_option("--vm-allocator", options.allocator,
+                   "The allocator for heap memory of the program: pool (default), malloc, arena "
+                   "(freed after each run), or hugepage.")
+        ->transform(CLI::CheckedTransformer(allocators));
 
     app.add_flag("--compile-only", options.compile_only, "Only compile, don't execute.");
     app.add_flag("--dump-ast", options.dump_ast, "Dump AST to stdout.");
     app.add_flag("--dump-bytecode", options.dump_bytecode, "Dump Bytecode to stdout.");
+    app.add_flag("--mem-report", options.mem_report,
+                 "Print memory usage and leaked heap blocks with their allocation site to stderr.");
 
     CLI11_PARSE(app, argc, argv);
 
@@ -0,0 +1,1209 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#include <clauf/preprocessor.hpp>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include <clauf/diagnostic.hpp>
+
+//=== include_cache ===//
+clauf::include_cache::~include_cache()
+{
+    for (auto& [path, entry] : _entries)
+        if (entry->size > 0)
+            munmap(const_cast<char*>(entry->data), entry->size);
+}
+
+clauf::include_cache::entry* clauf::include_cache::load(const std::string& path)
+{
+    auto canonical_ptr = realpath(path.c_str(), nullptr);
+    if (canonical_ptr == nullptr)
+        return nullptr;
+    auto canonical = std::string(canonical_ptr);
+    std::free(canonical_ptr);
+
+    if (auto iter = _entries.find(canonical); iter != _entries.end())
+        return iter->second.get();
+
+    auto fd = open(canonical.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    const char* data = "";
+    auto        size = std::size_t(0);
+    auto        ok   = false;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+    {
+        size = std::size_t(info.st_size);
+        if (size == 0)
+        {
+            // mmap() doesn't support empty mappings.
+            ok = true;
+        }
+        else if (auto result = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                 result != MAP_FAILED)
+        {
+            data = static_cast<const char*>(result);
+            ok   = true;
+        }
+    }
+    close(fd);
+    if (!ok)
+        return nullptr;
+
+    auto& result  = _entries[canonical];
+    result        = std::make_unique<entry>();
+    result->path  = canonical;
+    result->data  = data;
+    result->size  = size;
+    return result.get();
+}
+
+//=== preprocess ===//
+namespace
+{
+constexpr auto max_include_depth = 200;
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+bool is_identifier_start(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+bool is_identifier_char(char c)
+{
+    return is_identifier_start(c) || is_digit(c);
+}
+
+std::string_view trim(std::string_view str)
+{
+    while (!str.empty() && (is_space(str.front()) || str.front() == '\n'))
+        str.remove_prefix(1);
+    while (!str.empty() && (is_space(str.back()) || str.back() == '\n'))
+        str.remove_suffix(1);
+    return str;
+}
+
+std::size_t skip_spaces(std::string_view text, std::size_t pos)
+{
+    while (pos < text.size() && is_space(text[pos]))
+        ++pos;
+    return pos;
+}
+
+std::size_t identifier_end(std::string_view text, std::size_t pos)
+{
+    while (pos < text.size() && is_identifier_char(text[pos]))
+        ++pos;
+    return pos;
+}
+
+// Returns the position after the string or character literal that starts at pos.
+std::size_t literal_end(std::string_view text, std::size_t pos)
+{
+    auto quote = text[pos];
+    for (++pos; pos < text.size() && text[pos] != quote && text[pos] != '\n'; ++pos)
+        if (text[pos] == '\\' && pos + 1 < text.size())
+            ++pos;
+    return pos < text.size() && text[pos] == quote ? pos + 1 : pos;
+}
+
+// Returns the position after the preprocessing number that starts at pos.
+// It includes suffixes, so they aren't mistaken for identifiers.
+std::size_t number_end(std::string_view text, std::size_t pos)
+{
+    for (++pos; pos < text.size(); ++pos)
+    {
+        auto c = text[pos];
+        if (is_identifier_char(c) || c == '.')
+            continue;
+
+        auto prev = text[pos - 1];
+        if ((c == '+' || c == '-')
+            && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P'))
+            continue;
+
+        break;
+    }
+    return pos;
+}
+
+// Removes comments and joins lines that end in a backslash with the next one.
+// The newlines that are removed are added after the end of the logical line, so every logical line
+// still starts at its line number.
+std::string clean_source(std::string_view source)
+{
+    std::string result;
+    result.reserve(source.size());
+
+    auto pending_newlines = std::size_t(0);
+    for (auto pos = std::size_t(0); pos < source.size();)
+    {
+        auto c    = source[pos];
+        auto next = pos + 1 < source.size() ? source[pos + 1] : '\0';
+        if (c == '\\' && next == '\n')
+        {
+            ++pending_newlines;
+            pos += 2;
+        }
+        else if (c == '\\' && next == '\r' && pos + 2 < source.size() && source[pos + 2] == '\n')
+        {
+            ++pending_newlines;
+            pos += 3;
+        }
+        else if (c == '\n')
+        {
+            result.append(pending_newlines + 1, '\n');
+            pending_newlines = 0;
+            ++pos;
+        }
+        else if (c == '/' && next == '/')
+        {
+            while (pos < source.size() && source[pos] != '\n')
+                ++pos;
+            result += ' ';
+        }
+        else if (c == '/' && next == '*')
+        {
+            for (pos += 2; pos < source.size(); ++pos)
+            {
+                if (source[pos] == '*' && pos + 1 < source.size() && source[pos + 1] == '/')
+                {
+                    pos += 2;
+                    break;
+                }
+                else if (source[pos] == '\n')
+                    ++pending_newlines;
+            }
+            result += ' ';
+        }
+        else if (c == '"' || c == '\'')
+        {
+            auto end = literal_end(source, pos);
+            result.append(source.substr(pos, end - pos));
+            pos = end;
+        }
+        else
+        {
+            result += c;
+            ++pos;
+        }
+    }
+    result.append(pending_newlines, '\n');
+
+    return result;
+}
+
+// Surrounds the argument with quotes and escapes it.
+std::string stringify(std::string_view argument)
+{
+    std::string result = "\"";
+    for (auto c : trim(argument))
+    {
+        if (c == '\n')
+            c = ' ';
+        if (c == '"' || c == '\\')
+            result += '\\';
+        // Whitespace between tokens becomes a single space.
+        if (!(is_space(c) && !result.empty() && result.back() == ' '))
+            result += is_space(c) ? ' ' : c;
+    }
+    result += '"';
+    return result;
+}
+
+struct macro
+{
+    std::string              name;
+    bool                     is_function = false;
+    std::vector<std::string> parameters;
+    std::string              body;
+
+    std::size_t parameter_index(std::string_view identifier) const
+    {
+        return std::size_t(std::find(parameters.begin(), parameters.end(), identifier)
+                           - parameters.begin());
+    }
+};
+
+// The state of an #if ... #endif.
+struct conditional
+{
+    // Whether the code around the conditional is active.
+    bool outer_active;
+    // Whether one of the branches has been active.
+    bool taken;
+    bool active;
+    bool has_else;
+};
+
+class preprocessor
+{
+public:
+    explicit preprocessor(clauf::include_cache& cache, const std::vector<std::string>& include_dirs,
+                          clauf::diagnostic_logger& logger)
+    : _cache(&cache), _include_dirs(&include_dirs), _logger(&logger), _path(nullptr), _source(0),
+      _line(0), _include_depth(0), _counted(0), _output_lines(0)
+    {}
+
+    bool process(const std::string& path, std::string_view source,
+                 clauf::include_cache::entry* entry);
+
+    std::string     output;
+    clauf::line_map lines;
+
+private:
+    [[gnu::format(printf, 2, 3)]] bool error(const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        auto writer = _logger->vlog(clauf::diagnostic_kind::error, fmt, args);
+        va_end(args);
+
+        auto& source = lines.source_at(_source);
+        auto  begin  = source.find(_line, 1);
+        auto  end    = std::find(begin, source.data + source.size, '\n');
+        writer.source_annotation(clauf::annotation_kind::primary, source, {begin, end}, "here")
+            .finish();
+        return false;
+    }
+
+    // Records that the next line of the output comes from the line of the current file.
+    void map_line(unsigned line_nr)
+    {
+        _output_lines += unsigned(
+            std::count(output.begin() + std::ptrdiff_t(_counted), output.end(), '\n'));
+        _counted = output.size();
+        lines.add(_output_lines + 1, _source, line_nr);
+    }
+
+    bool is_active() const
+    {
+        return _conditionals.empty() || _conditionals.back().active;
+    }
+
+    bool process_directive(std::string_view line, clauf::include_cache::entry* entry);
+    bool define(std::string_view definition);
+    bool include(std::string_view spec);
+    bool evaluate(std::string_view expression, bool& result);
+
+    const macro* lookup(std::string_view name) const
+    {
+        if (_macros.empty())
+            return nullptr;
+
+        auto iter = _macros.find(name);
+        return iter == _macros.end() ? nullptr : iter->second.get();
+    }
+
+    // Appends text to out with all macros expanded.
+    // A macro is not expanded again inside its own expansion.
+    bool expand(std::string_view text, std::string& out, std::vector<const macro*>& disabled);
+    bool expand_invocation(const macro& m, std::string_view text, std::size_t& pos,
+                           std::string& out, std::vector<const macro*>& disabled);
+
+    clauf::include_cache*           _cache;
+    const std::vector<std::string>* _include_dirs;
+    clauf::diagnostic_logger*       _logger;
+
+    // Keyed by the name of the macro, which it owns.
+    std::unordered_map<std::string_view, std::unique_ptr<macro>> _macros;
+    std::vector<conditional>                                     _conditionals;
+    std::unordered_set<const clauf::include_cache::entry*>       _included;
+
+    const std::string* _path;
+    unsigned           _source;
+    unsigned           _line;
+    int                _include_depth;
+
+    // The number of lines in the first _counted bytes of the output.
+    std::size_t _counted;
+    unsigned    _output_lines;
+};
+
+bool preprocessor::process(const std::string& path, std::string_view source,
+                           clauf::include_cache::entry* entry)
+{
+    auto text = clean_source(source);
+
+    auto saved_path   = _path;
+    auto saved_source = _source;
+    auto saved_line   = _line;
+    _path             = &path;
+    _source           = lines.add_source(path, source.data(), source.size());
+    auto outer_depth  = _conditionals.size();
+    map_line(1);
+
+    // The file is guarded if it starts with #ifndef and the matching #endif is at the end.
+    auto        seen_line    = false;
+    std::string guard;
+    auto        guard_closed = false;
+
+    // Consecutive lines of code are expanded together, as macro invocations can span lines.
+    std::string block;
+    auto        block_line = 0u;
+    auto        flush      = [&] {
+        if (block.empty())
+            return true;
+
+        // Errors are reported at the beginning of the block.
+        auto line = _line;
+        _line     = block_line;
+
+        std::vector<const macro*> disabled;
+        auto                      success = expand(block, output, disabled);
+        block.clear();
+
+        _line = line;
+        return success;
+    };
+
+    _line = 0;
+    for (auto pos = std::size_t(0); pos < text.size();)
+    {
+        auto end = text.find('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+        auto line = std::string_view(text).substr(pos, end - pos);
+        pos       = end + 1;
+        ++_line;
+
+        auto first = skip_spaces(line, 0);
+        if (first == line.size())
+        {
+            (block.empty() ? output : block) += '\n';
+            continue;
+        }
+        else if (guard_closed)
+        {
+            // There is something after the guard.
+            guard.clear();
+            guard_closed = false;
+        }
+
+        if (line[first] != '#')
+        {
+            seen_line = true;
+            if (is_active())
+            {
+                if (block.empty())
+                    block_line = _line;
+                block.append(line);
+                block += '\n';
+            }
+            else
+            {
+                output += '\n';
+            }
+            continue;
+        }
+
+        if (!flush())
+            return false;
+
+        auto directive = line.substr(skip_spaces(line, first + 1));
+        auto name      = directive.substr(0, identifier_end(directive, 0));
+        if (!seen_line && name == "ifndef")
+            guard = std::string(trim(directive.substr(name.size())));
+        else if (_conditionals.size() == outer_depth + 1 && (name == "elif" || name == "else"))
+            // The guard must not have an alternative.
+            guard.clear();
+        seen_line = true;
+
+        if (!process_directive(directive, entry))
+            return false;
+        // An #include adds the lines of the file before the line of the directive.
+        map_line(_line);
+        output += '\n';
+
+        if (!guard.empty() && _conditionals.size() == outer_depth)
+            // The #endif of the guard.
+            guard_closed = true;
+    }
+    if (!flush())
+        return false;
+
+    if (_conditionals.size() != outer_depth)
+        return error("unterminated #if");
+
+    if (entry != nullptr && !entry->scanned)
+    {
+        entry->scanned = true;
+        if (guard_closed)
+            entry->guard = guard;
+    }
+
+    _path   = saved_path;
+    _source = saved_source;
+    _line   = saved_line;
+    return true;
+}
+
+bool preprocessor::process_directive(std::string_view directive,
+                                     clauf::include_cache::entry* entry)
+{
+    auto name = directive.substr(0, identifier_end(directive, 0));
+    auto rest = trim(directive.substr(name.size()));
+
+    //=== conditionals ===//
+    // They need to be processed even in inactive code, to find the matching #endif.
+    if (name == "if" || name == "ifdef" || name == "ifndef")
+    {
+        auto outer_active = is_active();
+        auto active       = false;
+        if (outer_active && name == "if")
+        {
+            if (!evaluate(rest, active))
+                return false;
+        }
+        else if (outer_active)
+        {
+            auto macro_name = rest.substr(0, identifier_end(rest, 0));
+            if (macro_name.empty() || macro_name.size() != rest.size())
+                return error("expected macro name after #%.*s", int(name.size()), name.data());
+
+            auto is_defined = lookup(macro_name) != nullptr;
+            active          = name == "ifdef" ? is_defined : !is_defined;
+        }
+
+        _conditionals.push_back({outer_active, active, active, false});
+        return true;
+    }
+    else if (name == "elif" || name == "else")
+    {
+        if (_conditionals.empty())
+            return error("#%.*s without #if", int(name.size()), name.data());
+
+        auto& cond = _conditionals.back();
+        if (cond.has_else)
+            return error("#%.*s after #else", int(name.size()), name.data());
+
+        if (!cond.outer_active || cond.taken)
+        {
+            cond.active = false;
+        }
+        else if (name == "elif")
+        {
+            if (!evaluate(rest, cond.active))
+                return false;
+        }
+        else
+        {
+            cond.active = true;
+        }
+        cond.taken    = cond.taken || cond.active;
+        cond.has_else = name == "else";
+        return true;
+    }
+    else if (name == "endif")
+    {
+        if (_conditionals.empty())
+            return error("#endif without #if");
+        _conditionals.pop_back();
+        return true;
+    }
+    else if (!is_active())
+    {
+        return true;
+    }
+
+    //=== other directives ===//
+    if (name.empty())
+    {
+        // The null directive.
+        return true;
+    }
+    else if (name == "define")
+    {
+        return define(rest);
+    }
+    else if (name == "undef")
+    {
+        auto macro_name = rest.substr(0, identifier_end(rest, 0));
+        if (macro_name.empty())
+            return error("expected macro name after #undef");
+        _macros.erase(macro_name);
+        return true;
+    }
+    else if (name == "include")
+    {
+        return include(rest);
+    }
+    else if (name == "pragma")
+    {
+        // Other pragmas are ignored.
+        if (rest == "once" && entry != nullptr)
+            entry->pragma_once = true;
+        return true;
+    }
+    else if (name == "error")
+    {
+        return error("#error %.*s", int(rest.size()), rest.data());
+    }
+    else
+    {
+        return error("unknown preprocessing directive '#%.*s'", int(name.size()), name.data());
+    }
+}
+
+bool preprocessor::define(std::string_view definition)
+{
+    auto name_end = identifier_end(definition, 0);
+    if (name_end == 0)
+        return error("expected macro name after #define");
+
+    auto m  = std::make_unique<macro>();
+    m->name = std::string(definition.substr(0, name_end));
+
+    auto pos = name_end;
+    // A function-like macro has the parenthesis directly after the name.
+    if (pos < definition.size() && definition[pos] == '(')
+    {
+        m->is_function = true;
+
+        pos = skip_spaces(definition, pos + 1);
+        if (pos < definition.size() && definition[pos] == ')')
+        {
+            ++pos;
+        }
+        else
+        {
+            while (true)
+            {
+                auto param_end = identifier_end(definition, pos);
+                if (param_end == pos)
+                    return error("expected parameter name in definition of macro '%s'",
+                                 m->name.c_str());
+                m->parameters.emplace_back(definition.substr(pos, param_end - pos));
+
+                pos = skip_spaces(definition, param_end);
+                if (pos < definition.size() && definition[pos] == ',')
+                {
+                    pos = skip_spaces(definition, pos + 1);
+                }
+                else if (pos < definition.size() && definition[pos] == ')')
+                {
+                    ++pos;
+                    break;
+                }
+                else
+                {
+                    return error("expected ',' or ')' in definition of macro '%s'",
+                                 m->name.c_str());
+                }
+            }
+        }
+    }
+
+    m->body = std::string(trim(definition.substr(pos)));
+
+    _macros.erase(m->name);
+    auto key = std::string_view(m->name);
+    _macros.emplace(key, std::move(m));
+    return true;
+}
+
+bool preprocessor::include(std::string_view spec)
+{
+    // The file name can also be the result of a macro.
+    std::string expanded;
+    if (!spec.empty() && spec.front() != '"' && spec.front() != '<')
+    {
+        std::vector<const macro*> disabled;
+        if (!expand(spec, expanded, disabled))
+            return false;
+        spec = trim(expanded);
+    }
+
+    auto is_quoted = !spec.empty() && spec.front() == '"';
+    auto close     = is_quoted ? '"' : '>';
+    if (spec.size() < 2 || (spec.front() != '"' && spec.front() != '<') || spec.back() != close)
+        return error("expected \"file\" or <file> after #include");
+    auto file_name = std::string(spec.substr(1, spec.size() - 2));
+
+    clauf::include_cache::entry* entry = nullptr;
+    if (is_quoted)
+    {
+        auto dir_end = _path->rfind('/');
+        auto path    = dir_end == std::string::npos ? file_name
+                                                    : _path->substr(0, dir_end + 1) + file_name;
+        entry        = _cache->load(path);
+    }
+    for (auto iter = _include_dirs->begin(); entry == nullptr && iter != _include_dirs->end();
+         ++iter)
+        entry = _cache->load(*iter + "/" + file_name);
+    if (entry == nullptr)
+        return error("cannot open include file '%s'", file_name.c_str());
+
+    // Including the file again would not add anything.
+    if (entry->pragma_once && _included.count(entry) > 0)
+        return true;
+    if (!entry->guard.empty() && lookup(entry->guard) != nullptr)
+        return true;
+
+    if (_include_depth == max_include_depth)
+        return error("#include nested too deeply");
+
+    _included.insert(entry);
+    ++_include_depth;
+    auto success = process(entry->path, {entry->data, entry->size}, entry);
+    --_include_depth;
+    return success;
+}
+
+bool preprocessor::expand(std::string_view text, std::string& out,
+                          std::vector<const macro*>& disabled)
+{
+    if (_macros.empty())
+    {
+        out.append(text);
+        return true;
+    }
+
+    for (auto pos = std::size_t(0); pos < text.size();)
+    {
+        auto c = text[pos];
+        if (c == '"' || c == '\'')
+        {
+            auto end = literal_end(text, pos);
+            out.append(text.substr(pos, end - pos));
+            pos = end;
+        }
+        else if (is_digit(c) || (c == '.' && pos + 1 < text.size() && is_digit(text[pos + 1])))
+        {
+            auto end = number_end(text, pos);
+            out.append(text.substr(pos, end - pos));
+            pos = end;
+        }
+        else if (is_identifier_start(c))
+        {
+            auto end  = identifier_end(text, pos);
+            auto name = text.substr(pos, end - pos);
+
+            auto m = lookup(name);
+            if (m == nullptr || std::find(disabled.begin(), disabled.end(), m) != disabled.end())
+            {
+                out.append(name);
+                pos = end;
+            }
+            else if (!m->is_function)
+            {
+                disabled.push_back(m);
+                auto success = expand(m->body, out, disabled);
+                disabled.pop_back();
+                if (!success)
+                    return false;
+                pos = end;
+            }
+            else
+            {
+                // A function-like macro is only invoked if it is followed by a parenthesis.
+                auto paren = end;
+                while (paren < text.size() && (is_space(text[paren]) || text[paren] == '\n'))
+                    ++paren;
+                if (paren == text.size() || text[paren] != '(')
+                {
+                    out.append(name);
+                    pos = end;
+                }
+                else
+                {
+                    pos = paren;
+                    if (!expand_invocation(*m, text, pos, out, disabled))
+                        return false;
+                }
+            }
+        }
+        else
+        {
+            out += c;
+            ++pos;
+        }
+    }
+    return true;
+}
+
+bool preprocessor::expand_invocation(const macro& m, std::string_view text, std::size_t& pos,
+                                     std::string& out, std::vector<const macro*>& disabled)
+{
+    // Split the arguments at the commas that aren't nested in parentheses.
+    std::vector<std::string_view> arguments;
+    auto                          newlines = std::size_t(0);
+    auto                          depth    = 0;
+    auto                          begin    = pos + 1;
+    for (++pos;; ++pos)
+    {
+        if (pos == text.size())
+            return error("unterminated invocation of macro '%s'", m.name.c_str());
+
+        auto c = text[pos];
+        if (c == '"' || c == '\'')
+        {
+            pos = literal_end(text, pos) - 1;
+        }
+        else if (c == '\n')
+        {
+            ++newlines;
+        }
+        else if (c == '(')
+        {
+            ++depth;
+        }
+        else if ((c == ',' && depth == 0) || (c == ')' && depth == 0))
+        {
+            arguments.push_back(text.substr(begin, pos - begin));
+            begin = pos + 1;
+            if (c == ')')
+                break;
+        }
+        else if (c == ')')
+        {
+            --depth;
+        }
+    }
+    ++pos;
+
+    if (m.parameters.empty() && arguments.size() == 1 && trim(arguments[0]).empty())
+        arguments.clear();
+    if (arguments.size() != m.parameters.size())
+        return error("macro '%s' expects %zu arguments, but %zu were given", m.name.c_str(),
+                     m.parameters.size(), arguments.size());
+
+    // Replace the parameters in the body.
+    // Arguments are macro expanded first, unless they are operands of # or ##.
+    std::string replacement;
+    auto        paste_next = false;
+    auto&       body       = m.body;
+    for (auto body_pos = std::size_t(0); body_pos < body.size();)
+    {
+        auto c = body[body_pos];
+        if (c == '#' && body_pos + 1 < body.size() && body[body_pos + 1] == '#')
+        {
+            while (!replacement.empty() && is_space(replacement.back()))
+                replacement.pop_back();
+            body_pos   = skip_spaces(body, body_pos + 2);
+            paste_next = true;
+            continue;
+        }
+        else if (c == '#')
+        {
+            auto param_begin = skip_spaces(body, body_pos + 1);
+            auto param_end   = identifier_end(body, param_begin);
+            auto index = m.parameter_index(std::string_view(body).substr(param_begin,
+                                                                         param_end - param_begin));
+            if (index == m.parameters.size())
+                return error("'#' is not followed by a parameter in macro '%s'", m.name.c_str());
+
+            replacement += stringify(arguments[index]);
+            body_pos = param_end;
+        }
+        else if (is_identifier_start(c))
+        {
+            auto end        = identifier_end(body, body_pos);
+            auto identifier = std::string_view(body).substr(body_pos, end - body_pos);
+            auto index      = m.parameter_index(identifier);
+            if (index == m.parameters.size())
+            {
+                replacement.append(identifier);
+            }
+            else
+            {
+                auto next     = skip_spaces(body, end);
+                auto is_paste = paste_next
+                                || (next + 1 < body.size() && body[next] == '#'
+                                    && body[next + 1] == '#');
+                if (is_paste)
+                {
+                    replacement.append(trim(arguments[index]));
+                }
+                else if (!expand(trim(arguments[index]), replacement, disabled))
+                {
+                    return false;
+                }
+            }
+            body_pos = end;
+        }
+        else if (c == '"' || c == '\'')
+        {
+            auto end = literal_end(body, body_pos);
+            replacement.append(body.substr(body_pos, end - body_pos));
+            body_pos = end;
+        }
+        else
+        {
+            replacement += c;
+            ++body_pos;
+            if (is_space(c))
+                continue;
+        }
+        paste_next = false;
+    }
+
+    // The arguments are on a single line now, so add the lines they spanned afterwards.
+    std::replace(replacement.begin(), replacement.end(), '\n', ' ');
+
+    disabled.push_back(&m);
+    auto success = expand(replacement, out, disabled);
+    disabled.pop_back();
+    out.append(newlines, '\n');
+    return success;
+}
+
+//=== #if expressions ===//
+class expression_parser
+{
+public:
+    explicit expression_parser(std::string_view text) : _text(text), _pos(0), _error(nullptr) {}
+
+    // Returns nullptr on success, or an error message.
+    const char* parse(std::int64_t& result)
+    {
+        result = parse_conditional(true);
+        skip();
+        if (_error == nullptr && _pos != _text.size())
+            _error = "unexpected token in #if expression";
+        return _error;
+    }
+
+private:
+    void skip()
+    {
+        _pos = skip_spaces(_text, _pos);
+    }
+
+    // Returns the operator at the current position, if any.
+    std::string_view peek_operator()
+    {
+        skip();
+        static constexpr std::string_view operators[]
+            = {"||", "&&", "==", "!=", "<=", ">=", "<<", ">>", "|", "^", "&",
+               "<",  ">",  "+",  "-",  "*",  "/",  "%",  "?",  ":"};
+        for (auto op : operators)
+            if (_text.substr(_pos, op.size()) == op)
+                return op;
+        return {};
+    }
+
+    // The binary operators by increasing precedence.
+    static int precedence(std::string_view op)
+    {
+        if (op == "||")
+            return 1;
+        else if (op == "&&")
+            return 2;
+        else if (op == "|")
+            return 3;
+        else if (op == "^")
+            return 4;
+        else if (op == "&")
+            return 5;
+        else if (op == "==" || op == "!=")
+            return 6;
+        else if (op == "<" || op == ">" || op == "<=" || op == ">=")
+            return 7;
+        else if (op == "<<" || op == ">>")
+            return 8;
+        else if (op == "+" || op == "-")
+            return 9;
+        else if (op == "*" || op == "/" || op == "%")
+            return 10;
+        else
+            return 0;
+    }
+
+    // Operands that are not evaluated, like the right one of `0 && x`, are parsed with evaluated
+    // set to false; they must be valid expressions, but can divide by zero.
+    std::int64_t parse_conditional(bool evaluated)
+    {
+        auto condition = parse_binary(1, evaluated);
+        if (peek_operator() != "?")
+            return condition;
+        ++_pos;
+
+        auto if_true = parse_conditional(evaluated && condition != 0);
+        if (peek_operator() != ":")
+        {
+            fail("expected ':' in #if expression");
+            return 0;
+        }
+        ++_pos;
+        auto if_false = parse_conditional(evaluated && condition == 0);
+
+        return condition != 0 ? if_true : if_false;
+    }
+
+    std::int64_t parse_binary(int min_precedence, bool evaluated)
+    {
+        auto lhs = parse_unary(evaluated);
+        while (_error == nullptr)
+        {
+            auto op   = peek_operator();
+            auto prec = precedence(op);
+            if (prec == 0 || prec < min_precedence)
+                break;
+            _pos += op.size();
+
+            // The right operand of || and && is only evaluated if the left one doesn't decide.
+            auto rhs_evaluated = evaluated;
+            if (op == "||")
+                rhs_evaluated = evaluated && lhs == 0;
+            else if (op == "&&")
+                rhs_evaluated = evaluated && lhs != 0;
+
+            auto rhs = parse_binary(prec + 1, rhs_evaluated);
+            lhs      = apply(op, lhs, rhs, rhs_evaluated);
+        }
+        return lhs;
+    }
+
+    std::int64_t apply(std::string_view op, std::int64_t lhs, std::int64_t rhs, bool evaluated)
+    {
+        // Arithmetic wraps around instead of overflowing.
+        auto ulhs = std::uint64_t(lhs);
+        auto urhs = std::uint64_t(rhs);
+        if (op == "||")
+            return lhs != 0 || rhs != 0;
+        else if (op == "&&")
+            return lhs != 0 && rhs != 0;
+        else if (op == "|")
+            return std::int64_t(ulhs | urhs);
+        else if (op == "^")
+            return std::int64_t(ulhs ^ urhs);
+        else if (op == "&")
+            return std::int64_t(ulhs & urhs);
+        else if (op == "==")
+            return lhs == rhs;
+        else if (op == "!=")
+            return lhs != rhs;
+        else if (op == "<")
+            return lhs < rhs;
+        else if (op == ">")
+            return lhs > rhs;
+        else if (op == "<=")
+            return lhs <= rhs;
+        else if (op == ">=")
+            return lhs >= rhs;
+        else if (op == "<<")
+            return std::int64_t(ulhs << (urhs & 63));
+        else if (op == ">>")
+            return lhs >> (urhs & 63);
+        else if (op == "+")
+            return std::int64_t(ulhs + urhs);
+        else if (op == "-")
+            return std::int64_t(ulhs - urhs);
+        else if (op == "*")
+            return std::int64_t(ulhs * urhs);
+
+        if (rhs == 0)
+        {
+            if (evaluated)
+                fail("division by zero in #if expression");
+            return 0;
+        }
+        else if (rhs == -1)
+        {
+            // Avoid the overflow of INT64_MIN / -1.
+            return op == "/" ? std::int64_t(0 - ulhs) : 0;
+        }
+        return op == "/" ? lhs / rhs : lhs % rhs;
+    }
+
+    std::int64_t parse_unary(bool evaluated)
+    {
+        skip();
+        if (_pos == _text.size())
+        {
+            fail("expected expression in #if");
+            return 0;
+        }
+
+        auto c = _text[_pos];
+        if (c == '!' || c == '~' || c == '-' || c == '+')
+        {
+            ++_pos;
+            auto operand = std::uint64_t(parse_unary(evaluated));
+            switch (c)
+            {
+            case '!':
+                return operand == 0;
+            case '~':
+                return std::int64_t(~operand);
+            case '-':
+                return std::int64_t(0 - operand);
+            default:
+                return std::int64_t(operand);
+            }
+        }
+        else if (c == '(')
+        {
+            ++_pos;
+            auto result = parse_conditional(evaluated);
+            skip();
+            if (_pos == _text.size() || _text[_pos] != ')')
+            {
+                fail("expected ')' in #if expression");
+                return 0;
+            }
+            ++_pos;
+            return result;
+        }
+        else if (is_digit(c))
+        {
+            auto end    = number_end(_text, _pos);
+            auto number = std::string(_text.substr(_pos, end - _pos));
+            _pos        = end;
+
+            char* suffix;
+            auto  result = std::strtoull(number.c_str(), &suffix, 0);
+            if (std::string_view(suffix).find_first_not_of("uUlL") != std::string_view::npos)
+                fail("invalid integer constant in #if expression");
+            return std::int64_t(result);
+        }
+        else if (c == '\'')
+        {
+            auto end     = literal_end(_text, _pos);
+            auto literal = _text.substr(_pos + 1, end - _pos - 2);
+            _pos         = end;
+            if (literal.size() == 1)
+                return literal[0];
+            else if (literal.size() == 2 && literal[0] == '\\')
+            {
+                switch (literal[1])
+                {
+                case 'n':
+                    return '\n';
+                case 't':
+                    return '\t';
+                case 'r':
+                    return '\r';
+                case '0':
+                    return '\0';
+                default:
+                    return literal[1];
+                }
+            }
+            fail("unsupported character constant in #if expression");
+            return 0;
+        }
+        else if (is_identifier_start(c))
+        {
+            // Identifiers that aren't macros are zero.
+            _pos = identifier_end(_text, _pos);
+            return 0;
+        }
+        else
+        {
+            fail("unexpected token in #if expression");
+            return 0;
+        }
+    }
+
+    void fail(const char* msg)
+    {
+        if (_error == nullptr)
+            _error = msg;
+        _pos = _text.size();
+    }
+
+    std::string_view _text;
+    std::size_t      _pos;
+    const char*      _error;
+};
+
+bool preprocessor::evaluate(std::string_view expression, bool& result)
+{
+    // Replace defined(name) and defined name before expanding macros.
+    std::string replaced;
+    for (auto pos = std::size_t(0); pos < expression.size();)
+    {
+        auto c = expression[pos];
+        if (c == '"' || c == '\'')
+        {
+            auto end = literal_end(expression, pos);
+            replaced.append(expression.substr(pos, end - pos));
+            pos = end;
+        }
+        else if (is_digit(c))
+        {
+            auto end = number_end(expression, pos);
+            replaced.append(expression.substr(pos, end - pos));
+            pos = end;
+        }
+        else if (is_identifier_start(c))
+        {
+            auto end        = identifier_end(expression, pos);
+            auto identifier = expression.substr(pos, end - pos);
+            if (identifier != "defined")
+            {
+                replaced.append(identifier);
+                pos = end;
+                continue;
+            }
+
+            pos              = skip_spaces(expression, end);
+            auto has_paren   = pos < expression.size() && expression[pos] == '(';
+            pos              = skip_spaces(expression, has_paren ? pos + 1 : pos);
+            auto name_end    = identifier_end(expression, pos);
+            auto macro_name  = expression.substr(pos, name_end - pos);
+            pos              = skip_spaces(expression, name_end);
+            if (macro_name.empty())
+                return error("expected macro name after defined");
+            if (has_paren)
+            {
+                if (pos == expression.size() || expression[pos] != ')')
+                    return error("expected ')' after defined(%.*s", int(macro_name.size()),
+                                 macro_name.data());
+                ++pos;
+            }
+
+            replaced += lookup(macro_name) != nullptr ? " 1 " : " 0 ";
+        }
+        else
+        {
+            replaced += c;
+            ++pos;
+        }
+    }
+
+    std::string               expanded;
+    std::vector<const macro*> disabled;
+    if (!expand(replaced, expanded, disabled))
+        return false;
+
+    std::int64_t value;
+    if (auto msg = expression_parser(expanded).parse(value))
+        return error("%s", msg);
+
+    result = value != 0;
+    return true;
+}
+} // namespace
+
+std::optional<clauf::preprocessed_file> clauf::preprocess(
+    include_cache& cache, const std::vector<std::string>& include_dirs, diagnostic_logger& logger,
+    const char* path, const char* data, std::size_t size)
+{
+    preprocessor pp(cache, include_dirs, logger);
+    pp.output.reserve(size);
+    if (!pp.process(path, {data, size}, nullptr))
+        return std::nullopt;
+    return preprocessed_file{std::move(pp.output), std::move(pp.lines)};
+}
@@ -0,0 +1,103 @@
+// Copyright (C) 2022 Jonathan Müller and clauf contributors
+// SPDX-License-Identifier: BSL-1.0
+
+#include <clauf/sort.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+// Below that, the overhead of the radix passes isn't worth it.
+constexpr auto radix_threshold = std::size_t(256);
+
+struct entry
+{
+    std::uint64_t key;
+    std::uint64_t index;
+};
+
+// Maps the key to an unsigned integer with the same order.
+std::uint64_t load_key(const unsigned char* elem, clauf::sort_key key)
+{
+    auto result = std::uint64_t(0);
+    std::memcpy(&result, elem + key.offset, key.size);
+    if (key.is_signed)
+    {
+        // Flip the sign bit, so negative values come first.
+        auto sign_bit = std::uint64_t(1) << (key.size * 8 - 1);
+        result ^= sign_bit;
+    }
+    return result;
+}
+
+void store_key(unsigned char* elem, std::uint64_t value, clauf::sort_key key)
+{
+    if (key.is_signed)
+        value ^= std::uint64_t(1) << (key.size * 8 - 1);
+    std::memcpy(elem + key.offset, &value, key.size);
+}
+
+void radix_sort(std::vector<entry>& entries, std::size_t key_size)
+{
+    std::vector<entry> buffer(entries.size());
+    for (auto byte = std::size_t(0); byte != key_size; ++byte)
+    {
+        auto shift = byte * 8;
+
+        std::size_t counts[256] = {};
+        for (auto& e : entries)
+            ++counts[(e.key >> shift) & 0xFF];
+        // All keys share the byte, so the pass wouldn't change anything.
+        if (counts[(entries.front().key >> shift) & 0xFF] == entries.size())
+            continue;
+
+        auto offset = std::size_t(0);
+        for (auto& count : counts)
+        {
+            auto cur = count;
+            count    = offset;
+            offset += cur;
+        }
+
+        for (auto& e : entries)
+            buffer[counts[(e.key >> shift) & 0xFF]++] = e;
+        entries.swap(buffer);
+    }
+}
+} // namespace
+
+void clauf::sort(void* base, std::size_t count, std::size_t elem_size, sort_key key)
+{
+    if (count < 2)
+        return;
+
+    auto elems = static_cast<unsigned char*>(base);
+
+    std::vector<entry> entries(count);
+    for (auto i = std::size_t(0); i != count; ++i)
+        entries[i] = {load_key(elems + i * elem_size, key), i};
+
+    if (count < radix_threshold)
+        std::sort(entries.begin(), entries.end(), [](const entry& lhs, const entry& rhs) {
+            return lhs.key < rhs.key || (lhs.key == rhs.key && lhs.index < rhs.index);
+        });
+    else
+        radix_sort(entries, key.size);
+
+    if (elem_size == key.size)
+    {
+        // The element is just the key, so we can write it back directly.
+        for (auto i = std::size_t(0); i != count; ++i)
+            store_key(elems + i * elem_size, entries[i].key, key);
+    }
+    else
+    {
+        std::vector<unsigned char> copy(elems, elems + count * elem_size);
+        for (auto i = std::size_t(0); i != count; ++i)
+            std::memcpy(elems + i * elem_size, copy.data() + entries[i].index * elem_size,
+                        elem_size);
+    }
+}
@@ -0,0 +1,6 @@
+// The error has to be reported here, and not in the file that includes it.
+
+int value(void)
+{
+    return unknown;
+}
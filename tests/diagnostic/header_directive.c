@@ -0,0 +1,6 @@
+#include "header_directive.h"
+
+int main(void)
+{
+    return 0;
+}
@@ -0,0 +1,3 @@
+// The error has to be reported here, and not in the file that includes it.
+
+#error reported in the header
@@ -0,0 +1,6 @@
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+int main(void)
+{
+    return MAX(1);
+}
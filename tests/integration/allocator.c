@@ -0,0 +1,62 @@
+struct node
+{
+    int          value;
+    struct node* next;
+};
+
+int main()
+{
+    // Many small allocations of the same size re-use the memory.
+    int i = 0;
+    while (i < 1000)
+    {
+        struct node* n = __clauf_malloc(sizeof(struct node));
+        n->value       = i;
+        n->next        = nullptr;
+        __clauf_free(n);
+        i += 1;
+    }
+
+    int* array = __clauf_calloc(4, sizeof(int));
+    __clauf_assert(array[0] == 0);
+    __clauf_assert(array[3] == 0);
+    array[0] = 11;
+    array[3] = 42;
+
+    // The contents are preserved.
+    array = __clauf_realloc(array, 8 * sizeof(int));
+    __clauf_assert(array[0] == 11);
+    __clauf_assert(array[3] == 42);
+    array[7] = 17;
+
+    array = __clauf_realloc(array, 1024 * sizeof(int));
+    __clauf_assert(array[0] == 11);
+    __clauf_assert(array[7] == 17);
+    __clauf_free(array);
+
+    int* ptr = __clauf_realloc(nullptr, sizeof(int));
+    *ptr     = 0;
+    __clauf_free(ptr);
+
+    unsigned int arena = __clauf_arena_create();
+    i                  = 0;
+    while (i < 3)
+    {
+        struct node* head = nullptr;
+        int          j    = 0;
+        while (j < 100)
+        {
+            struct node* n = __clauf_arena_alloc(arena, sizeof(struct node));
+            n->value       = j;
+            n->next        = head;
+            head           = n;
+            j += 1;
+        }
+        __clauf_assert(head->value == 99);
+        __clauf_assert(head->next->value == 98);
+
+        __clauf_arena_reset(arena);
+        i += 1;
+    }
+    __clauf_arena_destroy(arena);
+}
@@ -0,0 +1,17 @@
+void increment(void* ctx)
+{
+    int* counter = ctx;
+    *counter += 1;
+}
+
+int main()
+{
+    unsigned int start = __clauf_now_ns();
+
+    // The function is called at least once for warmup and once for each sample.
+    int counter = 0;
+    __clauf_bench("increment", increment, &counter);
+    __clauf_assert(counter > 3);
+
+    __clauf_assert(__clauf_now_ns() > start);
+}
@@ -0,0 +1,61 @@
+int main()
+{
+    unsigned int map = __clauf_map_create();
+    __clauf_assert(__clauf_map_size(map) == 0);
+
+    // The map grows as necessary.
+    unsigned int i = 0;
+    while (i < 1000)
+    {
+        __clauf_assert(__clauf_map_insert(map, i * 7, i));
+        i += 1;
+    }
+    __clauf_assert(__clauf_map_size(map) == 1000);
+    __clauf_assert(!__clauf_map_insert(map, 14, 42));
+
+    unsigned int value = 0;
+    __clauf_assert(__clauf_map_find(map, 14, &value));
+    __clauf_assert(value == 42);
+    __clauf_assert(__clauf_map_find(map, 6993, &value));
+    __clauf_assert(value == 999);
+    __clauf_assert(!__clauf_map_find(map, 15, &value));
+    __clauf_assert(__clauf_map_find(map, 0, nullptr));
+
+    __clauf_assert(__clauf_map_erase(map, 14));
+    __clauf_assert(!__clauf_map_erase(map, 14));
+    __clauf_assert(!__clauf_map_find(map, 14, nullptr));
+    __clauf_assert(__clauf_map_size(map) == 999);
+
+    // Byte string keys compare the contents, not the address.
+    char key[4] = {'a', 'b', 'c', 'd'};
+    __clauf_assert(__clauf_map_insert_bytes(map, "abcd", 4, 11));
+    __clauf_assert(__clauf_map_insert_bytes(map, "abc", 3, 17));
+    __clauf_assert(__clauf_map_find_bytes(map, key, 4, &value));
+    __clauf_assert(value == 11);
+    __clauf_assert(__clauf_map_find_bytes(map, key, 3, &value));
+    __clauf_assert(value == 17);
+    __clauf_assert(!__clauf_map_find_bytes(map, key, 2, &value));
+    __clauf_assert(__clauf_map_erase_bytes(map, key, 3));
+    __clauf_assert(!__clauf_map_find_bytes(map, "abc", 3, nullptr));
+    __clauf_assert(__clauf_map_size(map) == 1000);
+
+    __clauf_map_destroy(map);
+
+    unsigned int vector = __clauf_vector_create();
+    i                   = 0;
+    while (i < 100)
+    {
+        __clauf_vector_push(vector, i * i);
+        i += 1;
+    }
+    __clauf_assert(__clauf_vector_size(vector) == 100);
+    __clauf_assert(__clauf_vector_get(vector, 10) == 100);
+
+    __clauf_vector_set(vector, 10, 5);
+    __clauf_assert(__clauf_vector_get(vector, 10) == 5);
+
+    __clauf_assert(__clauf_vector_pop(vector) == 99 * 99);
+    __clauf_assert(__clauf_vector_size(vector) == 99);
+
+    __clauf_vector_destroy(vector);
+}
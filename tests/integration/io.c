@@ -0,0 +1,30 @@
+__clauf_native int open(__clauf_native_string const char* path, __clauf_native int flags);
+__clauf_native int close(__clauf_native int fd);
+
+int main()
+{
+    // The interpreter itself is always there.
+    int fd = open("/proc/self/exe", 0);
+    __clauf_assert(fd >= 0);
+
+    char magic[4];
+    char class[1];
+    unsigned int read_magic = __clauf_io_submit_read(fd, magic, 4, 0);
+    unsigned int read_class = __clauf_io_submit_read(fd, class, 1, 4);
+    unsigned int bad_fd     = __clauf_io_submit_read(-1, magic, 4, 0);
+
+    int results[3];
+    __clauf_assert(__clauf_io_wait(results, 3) == 3);
+    __clauf_assert(results[read_magic] == 4);
+    __clauf_assert(magic[1] == 'E');
+    __clauf_assert(magic[2] == 'L');
+    __clauf_assert(magic[3] == 'F');
+    __clauf_assert(results[read_class] == 1);
+    __clauf_assert(class[0] == 2);
+    __clauf_assert(results[bad_fd] < 0);
+
+    // Nothing is pending anymore.
+    __clauf_assert(__clauf_io_wait(results, 0) == 0);
+
+    close(fd);
+}
@@ -0,0 +1,49 @@
+__clauf_native int creat(__clauf_native_string const char* path,
+                         __clauf_native unsigned int mode);
+// int is 64 bit, just like a native off_t.
+__clauf_native int ftruncate(__clauf_native int fd, int length);
+__clauf_native int close(__clauf_native int fd);
+__clauf_native int unlink(__clauf_native_string const char* path);
+
+int main()
+{
+    unsigned int length = 42;
+    const char*  file   = __clauf_map_file("clauf_test_does_not_exist.txt", &length);
+    __clauf_assert(file == nullptr);
+    __clauf_assert(length == 0);
+
+    // The interpreter itself is always there.
+    file = __clauf_map_file("/proc/self/exe", &length);
+    __clauf_assert(file != nullptr);
+    __clauf_assert(length > 4);
+    __clauf_assert(file[0] == 127);
+    __clauf_assert(file[1] == 'E');
+    __clauf_assert(file[2] == 'L');
+    __clauf_assert(file[3] == 'F');
+
+    // The file can be scanned; the start is enough to find some zeroes.
+    unsigned int zeroes = 0;
+    unsigned int i      = 0;
+    while (i < length && i < 4096)
+    {
+        if (file[i] == 0)
+            zeroes += 1;
+        i += 1;
+    }
+    __clauf_assert(zeroes > 0);
+
+    __clauf_unmap_file(file);
+
+    // Files of 4 GiB or more cannot be addressed; a sparse file doesn't need the disk space.
+    int fd = creat("clauf_test_map_file_large.bin", 0600);
+    __clauf_assert(fd >= 0);
+    __clauf_assert(ftruncate(fd, 5 * 1024 * 1024 * 1024) == 0);
+    close(fd);
+
+    length = 42;
+    file   = __clauf_map_file("clauf_test_map_file_large.bin", &length);
+    __clauf_assert(file == nullptr);
+    __clauf_assert(length == 0);
+
+    unlink("clauf_test_map_file_large.bin");
+}
@@ -0,0 +1,27 @@
+__clauf_native int abs(__clauf_native int x);
+__clauf_native int toupper(__clauf_native int c);
+// labs() reads the entire register, so it sees any garbage in the upper bits of the argument.
+__clauf_native int labs(__clauf_native unsigned char x);
+__clauf_native unsigned int strcspn(__clauf_native_string const char* str,
+                                    __clauf_native_string const char* reject);
+__clauf_native int strncasecmp(__clauf_native_string const char* lhs,
+                               __clauf_native_string const char* rhs,
+                               __clauf_native unsigned int count);
+
+// Native functions are only resolved when called.
+__clauf_native int clauf_test_does_not_exist(__clauf_native int x);
+
+int main()
+{
+    __clauf_assert(abs(-11) == 11);
+    __clauf_assert(abs(42) == 42);
+    __clauf_assert(toupper('a') == 'A');
+    __clauf_assert(labs((unsigned char)300) == 44);
+
+    __clauf_assert(strcspn("", "") == 0);
+    __clauf_assert(strcspn("hello", "") == 5);
+
+    __clauf_assert(strncasecmp("hello", "HELP", 3) == 0);
+    __clauf_assert(strncasecmp("hello", "HELP", 4) < 0);
+}
+
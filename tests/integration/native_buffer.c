@@ -0,0 +1,41 @@
+__clauf_native void explicit_bzero(__clauf_native_buffer(count) void* dest,
+                                   __clauf_native unsigned int count);
+__clauf_native int bcmp(__clauf_native_buffer(count) const void* lhs,
+                        __clauf_native_buffer(count) const void* rhs,
+                        __clauf_native unsigned int count);
+
+// seed48() returns the previous seed, an array of three unsigned short.
+// The length of the returned buffer is read from the first element of the new seed, so it is
+// correct if that one is the size of the seed in bytes.
+__clauf_native_buffer(seed) unsigned short* seed48(__clauf_native unsigned short* seed);
+
+int main()
+{
+    char buffer[16];
+    buffer[0]  = 'a';
+    buffer[15] = 'a';
+    explicit_bzero(buffer, 16);
+    __clauf_assert(buffer[0] == 0);
+    __clauf_assert(buffer[15] == 0);
+
+    char other[16];
+    explicit_bzero(other, 16);
+    __clauf_assert(bcmp(buffer, other, 16) == 0);
+
+    other[8] = 'b';
+    __clauf_assert(bcmp(buffer, other, 8) == 0);
+    __clauf_assert(bcmp(buffer, other, 16) != 0);
+
+    unsigned short short seed[3];
+    seed[0] = 6;
+    seed[1] = 0x1234;
+    seed[2] = 0x5678;
+    seed48(seed);
+
+    seed[1] = 0;
+    seed[2] = 0;
+    unsigned short short* previous = seed48(seed);
+    __clauf_assert(previous[0] == 6);
+    __clauf_assert(previous[1] == 0x1234);
+    __clauf_assert(previous[2] == 0x5678);
+}
@@ -0,0 +1,38 @@
+// short is 32 bit, just like a native int.
+__clauf_native void qsort(__clauf_native void* base, __clauf_native unsigned int count,
+                          __clauf_native unsigned int size,
+                          __clauf_native int (*compare)(const void* lhs, const void* rhs));
+
+short compare(const void* lhs, const void* rhs)
+{
+    const int* a = lhs;
+    const int* b = rhs;
+    if (*a < *b)
+        return -1;
+    else if (*a > *b)
+        return 1;
+    else
+        return 0;
+}
+
+int main()
+{
+    int array[5];
+    array[0] = 3;
+    array[1] = 1;
+    array[2] = 4;
+    array[3] = 1;
+    array[4] = 5;
+
+    qsort(array, 5, sizeof(int), compare);
+    __clauf_assert(array[0] == 1);
+    __clauf_assert(array[1] == 1);
+    __clauf_assert(array[2] == 3);
+    __clauf_assert(array[3] == 4);
+    __clauf_assert(array[4] == 5);
+
+    // The closure is re-used.
+    qsort(array, 5, sizeof(int), compare);
+    __clauf_assert(array[0] == 1);
+}
+
@@ -0,0 +1,25 @@
+__clauf_native char* getenv(__clauf_native_string const char* name);
+__clauf_native_string char* strstr(__clauf_native_string const char* str,
+                                   __clauf_native_string const char* substr);
+
+int main()
+{
+    // The same native pointer is returned over and over again.
+    int i = 0;
+    while (i < 100000)
+    {
+        char* path = getenv("PATH");
+        __clauf_assert(path != nullptr);
+        i += 1;
+    }
+
+    // Pointers into the same string.
+    i = 0;
+    while (i < 100000)
+    {
+        char* space = strstr("hello world", " ");
+        __clauf_assert(*space == ' ');
+        __clauf_assert(space[1] == 'w');
+        i += 1;
+    }
+}
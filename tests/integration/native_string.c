@@ -0,0 +1,48 @@
+__clauf_native unsigned int strspn(__clauf_native_string const char* str,
+                                   __clauf_native_string const char* accept);
+__clauf_native_string char* strpbrk(__clauf_native_string const char* str,
+                                    __clauf_native_string const char* accept);
+
+int main()
+{
+    char str[8];
+    str[0] = 'a';
+    str[1] = 'b';
+    str[2] = 'c';
+    str[3] = '\0';
+
+    int i = 0;
+    while (i < 1000)
+    {
+        __clauf_assert(strspn(str, "abcde") == 3);
+        i += 1;
+    }
+
+    // The string gets shorter.
+    str[1] = '\0';
+    __clauf_assert(strspn(str, "abcde") == 1);
+
+    // The string gets longer.
+    str[1] = 'b';
+    str[3] = 'd';
+    str[4] = 'e';
+    str[5] = '\0';
+    __clauf_assert(strspn(str, "abcde") == 5);
+
+    // The returned string is the same one over and over again.
+    i = 0;
+    while (i < 1000)
+    {
+        char* rest = strpbrk(str, "cd");
+        __clauf_assert(rest[0] == 'c');
+        __clauf_assert(rest[2] == 'e');
+        __clauf_assert(rest[3] == '\0');
+        i += 1;
+    }
+
+    // The returned string gets shorter.
+    str[3] = '\0';
+    char* rest = strpbrk(str, "cd");
+    __clauf_assert(rest[0] == 'c');
+    __clauf_assert(rest[1] == '\0');
+}
@@ -0,0 +1,26 @@
+// short is 32 bit, just like a native int.
+struct div_result
+{
+    short quot;
+    short rem;
+};
+__clauf_native struct div_result div(__clauf_native int numer, __clauf_native int denom);
+
+// int is 64 bit, just like a native long long.
+struct lldiv_result
+{
+    int quot;
+    int rem;
+};
+__clauf_native struct lldiv_result lldiv(int numer, int denom);
+
+int main()
+{
+    struct div_result d = div(17, 5);
+    __clauf_assert(d.quot == 3);
+    __clauf_assert(d.rem == 2);
+
+    struct lldiv_result ll = lldiv(-17, 5);
+    __clauf_assert(ll.quot == -3);
+    __clauf_assert(ll.rem == -2);
+}
@@ -0,0 +1,16 @@
+// Every execution starts with the initial state, even when executed repeatedly.
+int counter = 11;
+
+int main()
+{
+    __clauf_assert(counter == 11);
+    counter += 1;
+
+    unsigned int arena = __clauf_arena_create();
+    __clauf_assert(arena == 1);
+    __clauf_arena_destroy(arena);
+
+    unsigned int map = __clauf_map_create();
+    __clauf_assert(map == 1);
+    __clauf_assert(__clauf_map_insert(map, counter, 0));
+}
@@ -0,0 +1,53 @@
+#include "preprocessor.h"
+// The include guard skips the second include, so the global isn't defined twice.
+#include "preprocessor.h"
+
+#include "preprocessor_guard.h"
+#include "preprocessor_guard.h"
+#if GUARD_INCLUDES != 1
+#    error "the include guard is ignored"
+#endif
+// Once the guard is undefined, the header must be included again.
+#undef PREPROCESSOR_GUARD_H
+#include "preprocessor_guard.h"
+#if GUARD_INCLUDES != 2
+#    error "the header is skipped although its guard is undefined"
+#endif
+
+#include "preprocessor_once.h"
+#include "preprocessor_once.h"
+
+#define ANSWER 42
+#define CONCAT(a, b) a##b
+
+#if VERSION >= 2 && defined(SQUARE)
+int feature = 1;
+#else
+int feature = 0;
+#endif
+
+#ifdef UNDEFINED
+#    error "UNDEFINED is not defined"
+#endif
+
+// Operands that aren't evaluated can divide by zero.
+#if 0 && 1 / 0
+#    error "the right operand of && is evaluated"
+#endif
+#if !(1 || 1 % 0) || (defined(ANSWER) ? 0 : 1 / 0)
+#    error "the right operand of || or the false branch of ?: is evaluated"
+#endif
+
+int main()
+{
+    __clauf_assert(ANSWER == 42);
+    __clauf_assert(SQUARE(1 + 2) == 9);
+    __clauf_assert(MAX(SQUARE(2),
+                       3)
+                   == 4);
+
+    int CONCAT(value, 1) = 11;
+    __clauf_assert(value1 == 11);
+
+    __clauf_assert(feature == 1);
+}
@@ -0,0 +1,10 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#define SQUARE(x) ((x) * (x))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define VERSION 2
+
+int included_count = 0;
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef PREPROCESSOR_GUARD_H
+#define PREPROCESSOR_GUARD_H
+
+#ifdef GUARD_INCLUDES
+#    undef GUARD_INCLUDES
+#    define GUARD_INCLUDES 2
+#else
+#    define GUARD_INCLUDES 1
+#endif
+
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+
+#ifdef ONCE_INCLUDED
+#    error "a #pragma once header is included twice"
+#endif
+#define ONCE_INCLUDED 1
@@ -0,0 +1,32 @@
+int main()
+{
+    __clauf_assert(__clauf_printf("hello %s!\n", "world") == 13);
+    __clauf_assert(__clauf_puts("hello") >= 0);
+
+    char buffer[64];
+    __clauf_assert(__clauf_sprintf(buffer, "%d %u %x %X %c %%", -42, 42, 255, 255, 'a') == 16);
+    __clauf_assert(buffer[0] == '-');
+    __clauf_assert(buffer[4] == '4');
+    __clauf_assert(buffer[7] == 'f');
+    __clauf_assert(buffer[10] == 'F');
+    __clauf_assert(buffer[13] == 'a');
+    __clauf_assert(buffer[15] == '%');
+    __clauf_assert(buffer[16] == '\0');
+
+    // Padding.
+    __clauf_assert(__clauf_sprintf(buffer, "[%5d|%-5d|%05d]", 42, 42, -42) == 19);
+    __clauf_assert(buffer[1] == ' ');
+    __clauf_assert(buffer[4] == '4');
+    __clauf_assert(buffer[7] == '4');
+    __clauf_assert(buffer[11] == ' ');
+    __clauf_assert(buffer[13] == '-');
+    __clauf_assert(buffer[14] == '0');
+    __clauf_assert(buffer[17] == '2');
+
+    int i = 0;
+    while (i < 1000)
+    {
+        __clauf_printf("%d: %s\n", i, buffer);
+        i += 1;
+    }
+}
@@ -0,0 +1,36 @@
+struct value
+{
+    int value;
+};
+
+int value = 1;
+
+int main()
+{
+    // Struct tags don't conflict with other identifiers.
+    struct value v = {2};
+    __clauf_assert(value == 1);
+    __clauf_assert(v.value == 2);
+
+    int x = 3;
+    {
+        // A nested declaration shadows the outer one until the end of the block.
+        int x = 4;
+        __clauf_assert(x == 4);
+        {
+            int value = 5;
+            __clauf_assert(value == 5);
+        }
+        __clauf_assert(value == 1);
+    }
+    __clauf_assert(x == 3);
+
+    int i = 0;
+    while (i < 3)
+    {
+        int x = i;
+        __clauf_assert(x == i);
+        i += 1;
+    }
+    __clauf_assert(x == 3);
+}
@@ -0,0 +1,48 @@
+struct record
+{
+    int key;
+    int id;
+};
+
+int main()
+{
+    int array[6] = {3, -1, 42, 0, -17, 3};
+    __clauf_sort(array, 6, sizeof(int), 0, sizeof(int), 1);
+    __clauf_assert(array[0] == -17);
+    __clauf_assert(array[1] == -1);
+    __clauf_assert(array[2] == 0);
+    __clauf_assert(array[3] == 3);
+    __clauf_assert(array[5] == 42);
+
+    // Large arrays use a different algorithm.
+    unsigned int large[1000];
+    unsigned int i = 0;
+    while (i < 1000)
+    {
+        large[i] = (i * 7919) % 1000;
+        i += 1;
+    }
+    __clauf_sort(large, 1000, sizeof(unsigned int), 0, sizeof(unsigned int), 0);
+    i = 0;
+    while (i < 1000)
+    {
+        __clauf_assert(large[i] == i);
+        i += 1;
+    }
+
+    // Elements with equal keys keep their order.
+    struct record records[4];
+    records[0].key = 2;
+    records[0].id  = 0;
+    records[1].key = 1;
+    records[1].id  = 1;
+    records[2].key = 2;
+    records[2].id  = 2;
+    records[3].key = 1;
+    records[3].id  = 3;
+    __clauf_sort(records, 4, sizeof(struct record), 0, sizeof(int), 1);
+    __clauf_assert(records[0].id == 1);
+    __clauf_assert(records[1].id == 3);
+    __clauf_assert(records[2].id == 0);
+    __clauf_assert(records[3].id == 2);
+}
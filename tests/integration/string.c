@@ -0,0 +1,34 @@
+// The string library is implemented by builtins.
+__clauf_native unsigned int strlen(const char* str);
+__clauf_native int strcmp(const char* lhs, const char* rhs);
+__clauf_native char* strchr(const char* str, __clauf_native int ch);
+__clauf_native char* strrchr(const char* str, __clauf_native int ch);
+__clauf_native void* memchr(const void* ptr, __clauf_native int ch, unsigned int count);
+__clauf_native int memcmp(const void* lhs, const void* rhs, unsigned int count);
+__clauf_native void* memcpy(void* dest, const void* src, unsigned int count);
+__clauf_native void* memset(void* dest, __clauf_native int ch, unsigned int count);
+
+int main()
+{
+    char str[16];
+    memset(str, 'a', 15);
+    str[15] = '\0';
+    __clauf_assert(strlen(str) == 15);
+
+    memcpy(str, "hello world", 12);
+    __clauf_assert(strlen(str) == 11);
+    __clauf_assert(strcmp(str, "hello world") == 0);
+    __clauf_assert(strcmp(str, "help") < 0);
+    __clauf_assert(memcmp(str, "help", 3) == 0);
+
+    // The result points into the original array.
+    char* o = strchr(str, 'o');
+    __clauf_assert(o == str + 4);
+    *o = '0';
+    __clauf_assert(strrchr(str, 'o') == str + 7);
+    __clauf_assert(strchr(str, 'x') == nullptr);
+
+    char* w = memchr(str, 'w', 11);
+    __clauf_assert(w == str + 6);
+    __clauf_assert(memchr(str, 'w', 6) == nullptr);
+}
@@ -0,0 +1,46 @@
+struct point
+{
+    int x;
+    int y;
+};
+
+struct node
+{
+    int          value;
+    struct node* next;
+};
+
+int counter = 0;
+
+__clauf_native unsigned int strlen(const char* str);
+
+static int helper()
+{
+    return 2;
+}
+
+int sum(struct point* p)
+{
+    return p->x + p->y + helper() - 2;
+}
+
+void increment()
+{
+    counter += 1;
+}
+
+int sum_list(struct node* head)
+{
+    int result = 0;
+    while (head != nullptr)
+    {
+        result += head->value;
+        head = head->next;
+    }
+    return result;
+}
+
+int name_length(const char* name)
+{
+    return strlen(name);
+}
@@ -0,0 +1,52 @@
+struct point
+{
+    int x;
+    int y;
+};
+
+// Defined in library.c as well; it refers to itself.
+struct node
+{
+    int          value;
+    struct node* next;
+};
+
+// Defined in library.c.
+extern int counter;
+int        sum(struct point* p);
+void       increment();
+int        sum_list(struct node* head);
+int        name_length(const char* name);
+
+// Declared in library.c as well.
+__clauf_native unsigned int strlen(const char* str);
+
+// Each translation unit has its own internal declarations.
+static int helper()
+{
+    return 1;
+}
+
+int main()
+{
+    struct point p = {11, 31};
+    __clauf_assert(sum(&p) == 42);
+
+    __clauf_assert(counter == 0);
+    increment();
+    increment();
+    __clauf_assert(counter == 2);
+
+    __clauf_assert(helper() == 1);
+
+    __clauf_assert(strlen("abc") == 3);
+    __clauf_assert(name_length("clauf") == 5);
+
+    struct node second;
+    second.value = 2;
+    second.next  = nullptr;
+    struct node first;
+    first.value = 40;
+    first.next  = &second;
+    __clauf_assert(sum_list(&first) == 42);
+}
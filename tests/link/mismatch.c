@@ -0,0 +1,14 @@
+// The members differ from the struct in library.c, so sum() can't be linked.
+struct point
+{
+    int x;
+    int z;
+};
+
+int sum(struct point* p);
+
+int main()
+{
+    struct point p = {11, 31};
+    return sum(&p);
+}
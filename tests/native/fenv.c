@@ -0,0 +1,14 @@
+// The floating-point environment functions are defined in libm, which is passed with --link.
+__clauf_native int fegetround();
+__clauf_native int fesetround(__clauf_native int mode);
+
+int main()
+{
+    int mode = fegetround();
+    __clauf_assert(fesetround(mode) == 0);
+    __clauf_assert(fegetround() == mode);
+
+    // An invalid rounding mode is rejected.
+    __clauf_assert(fesetround(-1) != 0);
+    __clauf_assert(fegetround() == mode);
+}
@@ -0,0 +1,10 @@
+int main()
+{
+    int* a = __clauf_malloc(sizeof(int));
+    __clauf_free(a);
+
+    // The memory is re-used by the next allocation of the same size.
+    int* b = __clauf_malloc(sizeof(int));
+    *b     = 11;
+    *a     = 42;
+}
@@ -0,0 +1,9 @@
+int main()
+{
+    int* a = __clauf_malloc(sizeof(int));
+
+    // The memory can be resized in place, but the old address is invalid anyway.
+    int* b = __clauf_realloc(a, 2 * sizeof(int));
+    b[1]   = 11;
+    *a     = 42;
+}